@@ -5,6 +5,7 @@
 #include <llvm/Instructions.h>
 #include <llvm/IntrinsicInst.h>
 #include <llvm/Metadata.h>
+#include <llvm/Pass.h>
 #include <llvm/Support/Path.h>
 #include <string>
 #include <llvm/Support/Debug.h>
@@ -28,6 +29,10 @@ public:
 	virtual bool doInitialization(llvm::Module &);
 };
 
+// Add id annotations to loads, stores and integer arguments, and mark
+// taint sources and sinks; return true if F is changed
+bool annotateFunction(llvm::Function &F);
+
 
 static inline bool isFunctionPointer(llvm::Type *Ty) {
 	llvm::PointerType *PTy = llvm::dyn_cast<llvm::PointerType>(Ty);
@@ -0,0 +1,412 @@
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file implements transfer functions of integer operations over
+/// CRange.  Operands are split into intervals that do not wrap around,
+/// in unsigned or signed order as the operation needs, and results of
+/// the intervals are joined.
+///
+//===----------------------------------------------------------------------===//
+
+#include <llvm/Instruction.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include "CRange.h"
+
+using namespace llvm;
+
+namespace {
+
+// [Lo, Hi], both included
+struct Interval {
+	APInt Lo, Hi;
+	Interval(const APInt &Lo_, const APInt &Hi_) : Lo(Lo_), Hi(Hi_) { }
+};
+
+typedef SmallVector<Interval, 2> IntervalList;
+
+} // anonymous namespace
+
+static void getUnsigned(const ConstantRange &CR, IntervalList &L) {
+	unsigned W = CR.getBitWidth();
+	if (CR.isEmptySet())
+		return;
+	if (CR.isFullSet()) {
+		L.push_back(Interval(APInt::getMinValue(W), APInt::getMaxValue(W)));
+		return;
+	}
+	APInt Last = CR.getUpper() - 1;
+	if (CR.getLower().ugt(Last)) {
+		L.push_back(Interval(APInt::getMinValue(W), Last));
+		L.push_back(Interval(CR.getLower(), APInt::getMaxValue(W)));
+	} else {
+		L.push_back(Interval(CR.getLower(), Last));
+	}
+}
+
+static void getSigned(const ConstantRange &CR, IntervalList &L) {
+	unsigned W = CR.getBitWidth();
+	if (CR.isEmptySet())
+		return;
+	if (CR.isFullSet()) {
+		L.push_back(Interval(APInt::getSignedMinValue(W),
+		                     APInt::getSignedMaxValue(W)));
+		return;
+	}
+	APInt Last = CR.getUpper() - 1;
+	if (CR.getLower().sgt(Last)) {
+		L.push_back(Interval(APInt::getSignedMinValue(W), Last));
+		L.push_back(Interval(CR.getLower(), APInt::getSignedMaxValue(W)));
+	} else {
+		L.push_back(Interval(CR.getLower(), Last));
+	}
+}
+
+// signed intervals of divisors, without zero, each of one sign
+static void getDivisors(const ConstantRange &CR, IntervalList &L) {
+	IntervalList S;
+	getSigned(CR, S);
+	unsigned W = CR.getBitWidth();
+	APInt Zero = APInt::getNullValue(W);
+	for (unsigned i = 0; i != S.size(); ++i) {
+		const Interval &I = S[i];
+		if (I.Lo.isNegative())
+			L.push_back(Interval(I.Lo, I.Hi.isNegative() ? I.Hi
+			                                             : Zero - 1));
+		if (I.Hi.sgt(Zero))
+			L.push_back(Interval(I.Lo.sgt(Zero) ? I.Lo : Zero + 1, I.Hi));
+	}
+}
+
+// [Lo, Hi] in either order
+static CRange fromInterval(const APInt &Lo, const APInt &Hi) {
+	APInt Upper = Hi + 1;
+	if (Lo == Upper)
+		return CRange(Lo.getBitWidth(), true);
+	return CRange(Lo, Upper);
+}
+
+static void join(CRange &CR, const APInt &Lo, const APInt &Hi) {
+	CR = CR.unionWith(fromInterval(Lo, Hi));
+}
+
+// bits shared by all values of an unsigned interval
+static void getKnownBits(const Interval &I, APInt &Zero, APInt &One) {
+	unsigned W = I.Lo.getBitWidth();
+	unsigned N = (I.Lo ^ I.Hi).countLeadingZeros();
+	APInt Mask = APInt::getHighBitsSet(W, N);
+	Zero = ~I.Lo & Mask;
+	One = I.Lo & Mask;
+}
+
+// ones up to the highest set bit of X, the greatest value of its length
+static APInt fillBits(const APInt &X) {
+	return APInt::getLowBitsSet(X.getBitWidth(), X.getActiveBits());
+}
+
+CRange CRange::binaryOp(unsigned Opcode, const CRange &RHS) const {
+	switch (Opcode) {
+	default: return makeFullSet(getBitWidth());
+	case Instruction::Add:  return add(RHS);
+	case Instruction::Sub:  return sub(RHS);
+	case Instruction::Mul:  return multiply(RHS);
+	case Instruction::UDiv: return udiv(RHS);
+	case Instruction::SDiv: return sdiv(RHS);
+	case Instruction::URem: return urem(RHS);
+	case Instruction::SRem: return srem(RHS);
+	case Instruction::Shl:  return shl(RHS);
+	case Instruction::LShr: return lshr(RHS);
+	case Instruction::AShr: return ashr(RHS);
+	case Instruction::And:  return binaryAnd(RHS);
+	case Instruction::Or:   return binaryOr(RHS);
+	case Instruction::Xor:  return binaryXor(RHS);
+	}
+}
+
+CRange CRange::castOp(unsigned Opcode, uint32_t BitWidth) const {
+	switch (Opcode) {
+	default: return makeFullSet(BitWidth);
+	case Instruction::Trunc:
+	case Instruction::ZExt:
+		return zextOrTrunc(BitWidth);
+	case Instruction::SExt:
+		if (BitWidth > getBitWidth())
+			return signExtend(BitWidth);
+		return zextOrTrunc(BitWidth);
+	case Instruction::BitCast:
+		if (BitWidth == getBitWidth())
+			return *this;
+		return makeFullSet(BitWidth);
+	}
+}
+
+// ConstantRange::multiply works on the unsigned hull; intersect with
+// the signed products of the bounds, in double width.
+CRange CRange::multiply(const CRange &RHS) const {
+	if (isEmptySet() || RHS.isEmptySet())
+		return makeEmptySet(getBitWidth());
+	CRange U = super::multiply(RHS);
+	unsigned W = getBitWidth();
+	APInt L[] = { getSignedMin().sext(W * 2), getSignedMax().sext(W * 2) };
+	APInt R[] = { RHS.getSignedMin().sext(W * 2),
+	              RHS.getSignedMax().sext(W * 2) };
+	APInt Lo = L[0] * R[0], Hi = Lo;
+	for (unsigned i = 0; i != 2; ++i) {
+		for (unsigned j = 0; j != 2; ++j) {
+			APInt P = L[i] * R[j];
+			if (P.slt(Lo))
+				Lo = P;
+			if (P.sgt(Hi))
+				Hi = P;
+		}
+	}
+	CRange S = fromInterval(Lo, Hi).truncate(W);
+	return U.intersectWith(S);
+}
+
+// With the divisor of one sign, the quotient is monotone in each
+// operand, so its extremes are at the corners.  The only overflow,
+// SMIN / -1, is the maximum of its corner and wraps to SMIN.
+CRange CRange::sdiv(const CRange &RHS) const {
+	unsigned W = getBitWidth();
+	CRange CR = makeEmptySet(W);
+	IntervalList L, R;
+	getSigned(*this, L);
+	getDivisors(RHS, R);
+	APInt SMax = APInt::getSignedMaxValue(W);
+	for (unsigned i = 0; i != L.size(); ++i) {
+		for (unsigned j = 0; j != R.size(); ++j) {
+			const APInt *X[] = { &L[i].Lo, &L[i].Hi };
+			const APInt *Y[] = { &R[j].Lo, &R[j].Hi };
+			bool Single = L[i].Lo == L[i].Hi && R[j].Lo == R[j].Hi;
+			APInt Lo = SMax, Hi = APInt::getSignedMinValue(W);
+			for (unsigned a = 0; a != 2; ++a) {
+				for (unsigned b = 0; b != 2; ++b) {
+					bool Ov = false;
+					APInt Q = X[a]->sdiv_ov(*Y[b], Ov);
+					if (Ov) {
+						join(CR, Q, Q);
+						if (Single)
+							continue;
+						Q = SMax;
+					}
+					if (Q.slt(Lo))
+						Lo = Q;
+					if (Q.sgt(Hi))
+						Hi = Q;
+				}
+			}
+			if (Lo.sle(Hi))
+				join(CR, Lo, Hi);
+		}
+	}
+	return CR;
+}
+
+// The remainder is the dividend if it is below the divisor, and grows
+// with it between multiples of a single divisor.  Otherwise it is below
+// the divisor and at most the dividend.
+CRange CRange::urem(const CRange &RHS) const {
+	unsigned W = getBitWidth();
+	CRange CR = makeEmptySet(W);
+	IntervalList L, R;
+	getUnsigned(*this, L);
+	getUnsigned(RHS, R);
+	for (unsigned j = 0; j != R.size(); ++j) {
+		if (R[j].Hi == 0)
+			continue;
+		APInt Min = R[j].Lo == 0 ? APInt(W, 1) : R[j].Lo;
+		for (unsigned i = 0; i != L.size(); ++i) {
+			if (L[i].Hi.ult(Min))
+				join(CR, L[i].Lo, L[i].Hi);
+			else if (R[j].Lo == R[j].Hi &&
+			         L[i].Lo.udiv(Min) == L[i].Hi.udiv(Min))
+				join(CR, L[i].Lo.urem(Min), L[i].Hi.urem(Min));
+			else
+				join(CR, APInt::getNullValue(W),
+				     APIntOps::umin(L[i].Hi, R[j].Hi - 1));
+		}
+	}
+	return CR;
+}
+
+// As urem on magnitudes, with the sign of the dividend.
+CRange CRange::srem(const CRange &RHS) const {
+	unsigned W = getBitWidth();
+	CRange CR = makeEmptySet(W);
+	IntervalList D;
+	getDivisors(RHS, D);
+	if (D.empty())
+		return CR;
+	// least and greatest magnitudes of divisors, unsigned
+	APInt MinMag = APInt::getMaxValue(W), MaxMag = APInt::getNullValue(W);
+	for (unsigned j = 0; j != D.size(); ++j) {
+		bool Neg = D[j].Lo.isNegative();
+		APInt Lo = Neg ? -D[j].Hi : D[j].Lo;
+		APInt Hi = Neg ? -D[j].Lo : D[j].Hi;
+		MinMag = APIntOps::umin(MinMag, Lo);
+		MaxMag = APIntOps::umax(MaxMag, Hi);
+	}
+	APInt Zero = APInt::getNullValue(W);
+	APInt Max = MaxMag - 1;
+	IntervalList L;
+	getSigned(*this, L);
+	for (unsigned i = 0; i != L.size(); ++i) {
+		const APInt &Lo = L[i].Lo, &Hi = L[i].Hi;
+		if (Lo.isNegative()) {
+			// negative part
+			APInt NegHi = Hi.isNegative() ? Hi : Zero - 1;
+			if ((-Lo).ult(MinMag))
+				join(CR, Lo, NegHi);
+			else if (MinMag == MaxMag &&
+			         (-Lo).udiv(MinMag) == (-NegHi).udiv(MinMag))
+				join(CR, -(-Lo).urem(MinMag), -(-NegHi).urem(MinMag));
+			else
+				join(CR, APIntOps::smax(Lo, -Max), Zero);
+		}
+		if (!Hi.isNegative()) {
+			// non-negative part
+			APInt PosLo = Lo.isNegative() ? Zero : Lo;
+			if (Hi.ult(MinMag))
+				join(CR, PosLo, Hi);
+			else if (MinMag == MaxMag &&
+			         PosLo.udiv(MinMag) == Hi.udiv(MinMag))
+				join(CR, PosLo.urem(MinMag), Hi.urem(MinMag));
+			else
+				join(CR, Zero, APIntOps::umin(Hi, Max));
+		}
+	}
+	return CR;
+}
+
+// Shifts that do not overflow are monotone in both operands; intersect
+// the unsigned and signed views.
+CRange CRange::shl(const CRange &RHS) const {
+	unsigned W = getBitWidth();
+	if (isEmptySet() || RHS.isEmptySet())
+		return makeEmptySet(W);
+	if (RHS.getUnsignedMax().uge(W))
+		return makeFullSet(W);
+	unsigned Min = RHS.getUnsignedMin().getZExtValue();
+	unsigned Max = RHS.getUnsignedMax().getZExtValue();
+
+	CRange U = makeEmptySet(W);
+	IntervalList L;
+	getUnsigned(*this, L);
+	for (unsigned i = 0; i != L.size(); ++i) {
+		if (L[i].Hi.countLeadingZeros() >= Max ||
+		    (L[i].Lo == L[i].Hi && Min == Max))
+			join(U, L[i].Lo.shl(Min), L[i].Hi.shl(Max));
+		else
+			join(U, APInt::getNullValue(W),
+			     APInt::getMaxValue(W).shl(Min));
+	}
+
+	L.clear();
+	getSigned(*this, L);
+	CRange S = makeEmptySet(W);
+	for (unsigned i = 0; i != L.size(); ++i) {
+		const APInt &Lo = L[i].Lo, &Hi = L[i].Hi;
+		if (Lo.shl(Max).ashr(Max) != Lo || Hi.shl(Max).ashr(Max) != Hi)
+			return U;
+		join(S, Lo.shl(Lo.isNegative() ? Max : Min),
+		     Hi.shl(Hi.isNegative() ? Min : Max));
+	}
+	return U.intersectWith(S);
+}
+
+CRange CRange::lshr(const CRange &RHS) const {
+	unsigned W = getBitWidth();
+	if (isEmptySet() || RHS.isEmptySet())
+		return makeEmptySet(W);
+	if (RHS.getUnsignedMax().uge(W))
+		return makeFullSet(W);
+	unsigned Min = RHS.getUnsignedMin().getZExtValue();
+	unsigned Max = RHS.getUnsignedMax().getZExtValue();
+	CRange CR = makeEmptySet(W);
+	IntervalList L;
+	getUnsigned(*this, L);
+	for (unsigned i = 0; i != L.size(); ++i)
+		join(CR, L[i].Lo.lshr(Max), L[i].Hi.lshr(Min));
+	return CR;
+}
+
+CRange CRange::ashr(const CRange &RHS) const {
+	unsigned W = getBitWidth();
+	if (isEmptySet() || RHS.isEmptySet())
+		return makeEmptySet(W);
+	if (RHS.getUnsignedMax().uge(W))
+		return makeFullSet(W);
+	unsigned Min = RHS.getUnsignedMin().getZExtValue();
+	unsigned Max = RHS.getUnsignedMax().getZExtValue();
+	CRange CR = makeEmptySet(W);
+	IntervalList L;
+	getSigned(*this, L);
+	for (unsigned i = 0; i != L.size(); ++i) {
+		const APInt &Lo = L[i].Lo, &Hi = L[i].Hi;
+		join(CR, Lo.ashr(Lo.isNegative() ? Min : Max),
+		     Hi.ashr(Hi.isNegative() ? Max : Min));
+	}
+	return CR;
+}
+
+// Bitwise operations: for each pair of unsigned intervals, the values
+// allowed by the known bits, within bounds of the operation.
+
+CRange CRange::binaryAnd(const CRange &RHS) const {
+	unsigned W = getBitWidth();
+	CRange CR = makeEmptySet(W);
+	IntervalList L, R;
+	getUnsigned(*this, L);
+	getUnsigned(RHS, R);
+	for (unsigned i = 0; i != L.size(); ++i) {
+		for (unsigned j = 0; j != R.size(); ++j) {
+			APInt LZ, LO, RZ, RO;
+			getKnownBits(L[i], LZ, LO);
+			getKnownBits(R[j], RZ, RO);
+			APInt Hi = APIntOps::umin(~(LZ | RZ), APIntOps::umin(L[i].Hi, R[j].Hi));
+			join(CR, LO & RO, Hi);
+		}
+	}
+	return CR;
+}
+
+CRange CRange::binaryOr(const CRange &RHS) const {
+	unsigned W = getBitWidth();
+	CRange CR = makeEmptySet(W);
+	IntervalList L, R;
+	getUnsigned(*this, L);
+	getUnsigned(RHS, R);
+	for (unsigned i = 0; i != L.size(); ++i) {
+		for (unsigned j = 0; j != R.size(); ++j) {
+			APInt LZ, LO, RZ, RO;
+			getKnownBits(L[i], LZ, LO);
+			getKnownBits(R[j], RZ, RO);
+			APInt Lo = APIntOps::umax(LO | RO,
+			                          APIntOps::umax(L[i].Lo, R[j].Lo));
+			APInt Hi = ~(LZ & RZ) & fillBits(APIntOps::umax(L[i].Hi, R[j].Hi));
+			join(CR, Lo, Hi);
+		}
+	}
+	return CR;
+}
+
+CRange CRange::binaryXor(const CRange &RHS) const {
+	unsigned W = getBitWidth();
+	CRange CR = makeEmptySet(W);
+	IntervalList L, R;
+	getUnsigned(*this, L);
+	getUnsigned(RHS, R);
+	for (unsigned i = 0; i != L.size(); ++i) {
+		for (unsigned j = 0; j != R.size(); ++j) {
+			APInt LZ, LO, RZ, RO;
+			getKnownBits(L[i], LZ, LO);
+			getKnownBits(R[j], RZ, RO);
+			APInt Lo = (LZ & RO) | (LO & RZ);
+			APInt Zero = (LZ & RZ) | (LO & RO);
+			APInt Hi = ~Zero & fillBits(APIntOps::umax(L[i].Hi, R[j].Hi));
+			join(CR, Lo, Hi);
+		}
+	}
+	return CR;
+}
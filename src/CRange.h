@@ -41,12 +41,24 @@ public:
 		return Old != *this;
 	}
 
+	// Transfer functions.  Each result includes every value the
+	// operation yields on members of the operands.  Division and
+	// remainder by zero are undefined and contribute nothing; shifts by
+	// the bit width or more are undefined and make the result full.
 
-	CRange sdiv(const CRange &RHS) const {
-		if (isEmptySet() || RHS.isEmptySet())
-			return makeEmptySet(getBitWidth());
-		// FIXME: too conservative.
-		return makeFullSet(getBitWidth());
-	}
+	// The result of a binary operator or cast instruction, full for
+	// opcodes that take no integers.
+	CRange binaryOp(unsigned Opcode, const CRange &RHS) const;
+	CRange castOp(unsigned Opcode, uint32_t BitWidth) const;
 
+	CRange multiply(const CRange &RHS) const;
+	CRange sdiv(const CRange &RHS) const;
+	CRange urem(const CRange &RHS) const;
+	CRange srem(const CRange &RHS) const;
+	CRange shl(const CRange &RHS) const;
+	CRange lshr(const CRange &RHS) const;
+	CRange ashr(const CRange &RHS) const;
+	CRange binaryAnd(const CRange &RHS) const;
+	CRange binaryOr(const CRange &RHS) const;
+	CRange binaryXor(const CRange &RHS) const;
 };
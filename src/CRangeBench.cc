@@ -0,0 +1,99 @@
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Microbenchmark of the CRange transfer functions: the time per call
+/// of each operation on random ranges of common bit widths.
+///
+//===----------------------------------------------------------------------===//
+
+#include <llvm/Instruction.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/TimeValue.h>
+#include <llvm/Support/raw_ostream.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "CRange.h"
+
+using namespace llvm;
+
+static const unsigned NumRanges = 256;
+
+static uint64_t Seed = 88172645463325252ULL;
+
+// xorshift, so that runs are comparable
+static uint64_t random64() {
+	Seed ^= Seed << 13;
+	Seed ^= Seed >> 7;
+	Seed ^= Seed << 17;
+	return Seed;
+}
+
+// Random ranges: a mix of small and large sets, some around zero and
+// some wrapping, as in analyzed programs.
+static CRange randomRange(unsigned W) {
+	switch (random64() % 8) {
+	case 0: return CRange(W, true);
+	case 1: return CRange(APInt(W, random64() % 64));
+	}
+	APInt Lo(W, random64());
+	uint64_t Size = random64() % 4 ? random64() % 1024 : random64();
+	if (random64() % 2)
+		Lo = APInt(W, -(int64_t)(random64() % 512), true);
+	APInt Hi = Lo + APInt(W, Size + 1);
+	if (Lo == Hi)
+		return CRange(W, true);
+	return CRange(Lo, Hi);
+}
+
+static double now() {
+	TimeValue T = TimeValue::now();
+	return T.seconds() + T.nanoseconds() / 1e9;
+}
+
+int main(int argc, char **argv) {
+	unsigned Rounds = argc > 1 ? atoi(argv[1]) : 20;
+	static const unsigned Binary[] = {
+		Instruction::Add, Instruction::Sub, Instruction::Mul,
+		Instruction::UDiv, Instruction::SDiv, Instruction::URem,
+		Instruction::SRem, Instruction::Shl, Instruction::LShr,
+		Instruction::AShr, Instruction::And, Instruction::Or,
+		Instruction::Xor,
+	};
+	static const unsigned Widths[] = { 8, 32, 64 };
+
+	raw_ostream &OS = outs();
+	OS << "op      ";
+	for (unsigned w = 0; w != 3; ++w)
+		OS << format("  i%-2u ns/op", Widths[w]);
+	OS << "\n";
+
+	// checksum of results, so that no call is optimized away
+	unsigned Sum = 0;
+	for (unsigned o = 0; o != sizeof(Binary) / sizeof(Binary[0]); ++o) {
+		unsigned Opcode = Binary[o];
+		OS << format("%-8s", Instruction::getOpcodeName(Opcode));
+		for (unsigned w = 0; w != 3; ++w) {
+			std::vector<CRange> L, R;
+			for (unsigned i = 0; i != NumRanges; ++i) {
+				L.push_back(randomRange(Widths[w]));
+				R.push_back(randomRange(Widths[w]));
+			}
+			// shift amounts are mostly small
+			if (Opcode == Instruction::Shl || Opcode == Instruction::LShr ||
+			    Opcode == Instruction::AShr)
+				for (unsigned i = 0; i != NumRanges; ++i)
+					R[i] = CRange(APInt(Widths[w], random64() % Widths[w]));
+			double Start = now();
+			for (unsigned r = 0; r != Rounds; ++r)
+				for (unsigned i = 0; i != NumRanges; ++i)
+					for (unsigned j = 0; j != NumRanges; j += 8)
+						Sum += L[i].binaryOp(Opcode, R[j]).isFullSet();
+			double Calls = (double)Rounds * NumRanges * (NumRanges / 8);
+			OS << format("  %10.1f", (now() - Start) * 1e9 / Calls);
+		}
+		OS << "\n";
+	}
+	OS << "checksum " << Sum << "\n";
+	return 0;
+}
@@ -0,0 +1,157 @@
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Exhaustive soundness test of the CRange transfer functions: for all
+/// pairs of ranges of small bit widths, the result of an operation must
+/// include the operation on every pair of members.  Operations on single
+/// values must also give single values.
+///
+//===----------------------------------------------------------------------===//
+
+#include <llvm/Instruction.h>
+#include <llvm/Support/raw_ostream.h>
+#include <vector>
+
+#include "CRange.h"
+
+using namespace llvm;
+
+static const unsigned MaxBits = 4;
+
+static unsigned Failures;
+
+// all ranges of a bit width, including empty and full sets
+static void getRanges(unsigned W, std::vector<CRange> &Ranges) {
+	Ranges.push_back(CRange(W, false));
+	Ranges.push_back(CRange(W, true));
+	unsigned N = 1U << W;
+	for (unsigned L = 0; L != N; ++L)
+		for (unsigned U = 0; U != N; ++U)
+			if (L != U)
+				Ranges.push_back(CRange(APInt(W, L), APInt(W, U)));
+}
+
+static void getMembers(const CRange &CR, std::vector<APInt> &Vals) {
+	unsigned W = CR.getBitWidth();
+	for (unsigned i = 0, N = 1U << W; i != N; ++i)
+		if (CR.contains(APInt(W, i)))
+			Vals.push_back(APInt(W, i));
+}
+
+// evaluate Opcode, false if undefined
+static bool eval(unsigned Opcode, const APInt &X, const APInt &Y, APInt &Z) {
+	unsigned W = X.getBitWidth();
+	switch (Opcode) {
+	default: return false;
+	case Instruction::Add:  Z = X + Y; break;
+	case Instruction::Sub:  Z = X - Y; break;
+	case Instruction::Mul:  Z = X * Y; break;
+	case Instruction::UDiv: if (Y == 0) return false; Z = X.udiv(Y); break;
+	case Instruction::SDiv: if (Y == 0) return false; Z = X.sdiv(Y); break;
+	case Instruction::URem: if (Y == 0) return false; Z = X.urem(Y); break;
+	case Instruction::SRem: if (Y == 0) return false; Z = X.srem(Y); break;
+	case Instruction::Shl:
+		if (Y.uge(W)) return false;
+		Z = X.shl(Y.getZExtValue());
+		break;
+	case Instruction::LShr:
+		if (Y.uge(W)) return false;
+		Z = X.lshr(Y.getZExtValue());
+		break;
+	case Instruction::AShr:
+		if (Y.uge(W)) return false;
+		Z = X.ashr(Y.getZExtValue());
+		break;
+	case Instruction::And:  Z = X & Y; break;
+	case Instruction::Or:   Z = X | Y; break;
+	case Instruction::Xor:  Z = X ^ Y; break;
+	}
+	return true;
+}
+
+static void fail(const char *Name, const CRange &L, const CRange &R,
+                 const CRange &Res, const APInt &X, const APInt &Y) {
+	if (++Failures > 20)
+		return;
+	errs() << Name << " " << L << " " << R << " = " << Res << " misses "
+	       << X << ", " << Y << "\n";
+}
+
+static void testBinary(unsigned Opcode) {
+	const char *Name = Instruction::getOpcodeName(Opcode);
+	for (unsigned W = 1; W <= MaxBits; ++W) {
+		std::vector<CRange> Ranges;
+		getRanges(W, Ranges);
+		std::vector<std::vector<APInt> > Members(Ranges.size());
+		for (unsigned i = 0; i != Ranges.size(); ++i)
+			getMembers(Ranges[i], Members[i]);
+		for (unsigned i = 0; i != Ranges.size(); ++i) {
+			for (unsigned j = 0; j != Ranges.size(); ++j) {
+				const CRange &L = Ranges[i], &R = Ranges[j];
+				CRange Res = L.binaryOp(Opcode, R);
+				bool Single = Members[i].size() == 1 && Members[j].size() == 1;
+				for (unsigned x = 0; x != Members[i].size(); ++x) {
+					for (unsigned y = 0; y != Members[j].size(); ++y) {
+						const APInt &X = Members[i][x], &Y = Members[j][y];
+						APInt Z;
+						if (!eval(Opcode, X, Y, Z))
+							continue;
+						if (!Res.contains(Z))
+							fail(Name, L, R, Res, X, Y);
+						else if (Single && !Res.isSingleElement())
+							fail(Name, L, R, Res, X, Y);
+					}
+				}
+			}
+		}
+	}
+}
+
+static void testCast(unsigned Opcode) {
+	const char *Name = Instruction::getOpcodeName(Opcode);
+	for (unsigned W = 1; W <= MaxBits; ++W) {
+		std::vector<CRange> Ranges;
+		getRanges(W, Ranges);
+		for (unsigned DW = 1; DW <= MaxBits + 2; ++DW) {
+			if ((Opcode == Instruction::Trunc && DW >= W) ||
+			    (Opcode != Instruction::Trunc && DW <= W))
+				continue;
+			for (unsigned i = 0; i != Ranges.size(); ++i) {
+				const CRange &CR = Ranges[i];
+				CRange Res = CR.castOp(Opcode, DW);
+				std::vector<APInt> Vals;
+				getMembers(CR, Vals);
+				for (unsigned x = 0; x != Vals.size(); ++x) {
+					const APInt &X = Vals[x];
+					APInt Z = Opcode == Instruction::SExt ? X.sext(DW)
+					        : Opcode == Instruction::ZExt ? X.zext(DW)
+					        : X.trunc(DW);
+					if (!Res.contains(Z))
+						fail(Name, CR, CRange(APInt(W, 0)), Res, X, X);
+				}
+			}
+		}
+	}
+}
+
+int main() {
+	static const unsigned Binary[] = {
+		Instruction::Add, Instruction::Sub, Instruction::Mul,
+		Instruction::UDiv, Instruction::SDiv, Instruction::URem,
+		Instruction::SRem, Instruction::Shl, Instruction::LShr,
+		Instruction::AShr, Instruction::And, Instruction::Or,
+		Instruction::Xor,
+	};
+	static const unsigned Casts[] = {
+		Instruction::Trunc, Instruction::ZExt, Instruction::SExt,
+	};
+	for (unsigned i = 0; i != sizeof(Binary) / sizeof(Binary[0]); ++i)
+		testBinary(Binary[i]);
+	for (unsigned i = 0; i != sizeof(Casts) / sizeof(Casts[0]); ++i)
+		testCast(Casts[i]);
+	if (Failures) {
+		errs() << Failures << " failures\n";
+		return 1;
+	}
+	return 0;
+}
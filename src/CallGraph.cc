@@ -5,8 +5,10 @@
 #include <llvm/Support/InstIterator.h>
 #include <llvm/Module.h>
 #include <llvm/Constants.h>
+#include <llvm/ADT/DenseSet.h>
 #include <llvm/ADT/StringExtras.h>
 #include <llvm/Analysis/CallGraph.h>
+#include <algorithm>
 
 #include "Annotation.h"
 #include "IntGlobal.h"
@@ -29,8 +31,9 @@ CallGraphPass::processInitializers(Module *M, Constant *I, GlobalValue *V) {
 			} else if (isFunctionPointer(ETy)) {
 				// found function pointers in struct fields
 				if (Function *F = dyn_cast<Function>(CS->getOperand(i))) {
-					std::string Id = getStructId(STy, M, i);
-					Ctx->FuncPtrs[Id].insert(F);
+					GlobalID Id = Ctx->Ids.get(getStructId(STy, M, i));
+					if (Id)
+						Ctx->FuncPtrs[Id].set(Ctx->FuncTab.get(F));
 				}
 			}
 		}
@@ -42,121 +45,124 @@ CallGraphPass::processInitializers(Module *M, Constant *I, GlobalValue *V) {
 	} else if (Function *F = dyn_cast<Function>(I)) {
 		// global function pointer variables
 		if (V) {
-			std::string Id = getVarId(V);
-			Ctx->FuncPtrs[Id].insert(F);
+			GlobalID Id = Ctx->Ids.get(getVarId(V));
+			Ctx->FuncPtrs[Id].set(Ctx->FuncTab.get(F));
 		}
 	}
 }
 
-bool CallGraphPass::mergeFuncSet(FuncSet &S, const std::string &Id) {
-	FuncPtrMap::iterator i = Ctx->FuncPtrs.find(Id);
-	if (i != Ctx->FuncPtrs.end())
-		return mergeFuncSet(S, i->second);
+bool CallGraphPass::mergeFuncSet(FuncSet &S, GlobalID Id) {
+	addRead(Id);
+	if (const FuncSet *Src = Ctx->FuncPtrs.find(Id))
+		return mergeFuncSet(S, *Src);
 	return false;
 }
 
 bool CallGraphPass::mergeFuncSet(FuncSet &Dst, const FuncSet &Src) {
-	bool Changed = false;
-	for (FuncSet::const_iterator i = Src.begin(), e = Src.end(); i != e; ++i)
-		Changed |= Dst.insert(*i);
-	return Changed;
+	return Dst |= Src;
 }
 
 
 bool CallGraphPass::findFunctions(Value *V, FuncSet &S) {
+	Operand Op;
 	SmallPtrSet<Value *, 4> Visited;
-	return findFunctions(V, S, Visited);
+	collect(V, Op, Visited);
+	bool Changed = mergeFuncSet(S, Op.Funcs);
+	for (unsigned i = 0; i != Op.Srcs.size(); ++i)
+		Changed |= mergeFuncSet(S, Op.Srcs[i]);
+	return Changed;
 }
 
-bool CallGraphPass::findFunctions(Value *V, FuncSet &S, 
-                                  SmallPtrSet<Value *, 4> Visited) {
+void CallGraphPass::collect(Value *V, Operand &Op,
+                            SmallPtrSet<Value *, 4> &Visited) {
 	if (!Visited.insert(V))
-		return false;
+		return;
 
-	// real function, S = S + {F}
+	// real function, Op = Op + {F}
 	if (Function *F = dyn_cast<Function>(V)) {
-		if (!F->empty())
-			return S.insert(F);
+		if (hasBody(F)) {
+			Op.Funcs.set(Ctx->FuncTab.get(F));
+			return;
+		}
 
 		// prefer the real definition to declarations
-		FuncMap::iterator it = Ctx->Funcs.find(F->getName());
-		if (it != Ctx->Funcs.end())
-			return S.insert(it->second);
+		if (FuncID Def = Ctx->FuncTab.getDefinition(F->getName()))
+			Op.Funcs.set(Def);
 		else
-			return S.insert(F);
+			Op.Funcs.set(Ctx->FuncTab.get(F));
+		return;
 	}
 
 	// bitcast, ignore the cast
 	if (BitCastInst *B = dyn_cast<BitCastInst>(V))
-		return findFunctions(B->getOperand(0), S, Visited);
+		return collect(B->getOperand(0), Op, Visited);
 	
 	// const bitcast, ignore the cast
 	if (ConstantExpr *C = dyn_cast<ConstantExpr>(V)) {
 		if (C->isCast())
-			return findFunctions(C->getOperand(0), S, Visited);
+			return collect(C->getOperand(0), Op, Visited);
 	}
 	
 	// PHI node, recursively collect all incoming values
 	if (PHINode *P = dyn_cast<PHINode>(V)) {
-		bool Changed = false;
 		for (unsigned i = 0; i != P->getNumIncomingValues(); ++i)
-			Changed |= findFunctions(P->getIncomingValue(i), S, Visited);
-		return Changed;
+			collect(P->getIncomingValue(i), Op, Visited);
+		return;
 	}
 	
 	// select, recursively collect both paths
 	if (SelectInst *SI = dyn_cast<SelectInst>(V)) {
-		bool Changed = false;
-		Changed |= findFunctions(SI->getTrueValue(), S, Visited);
-		Changed |= findFunctions(SI->getFalseValue(), S, Visited);
-		return Changed;
+		collect(SI->getTrueValue(), Op, Visited);
+		collect(SI->getFalseValue(), Op, Visited);
+		return;
 	}
-	
-	// arguement, S = S + FuncPtrs[arg.ID]
-	if (Argument *A = dyn_cast<Argument>(V))
-		return mergeFuncSet(S, getArgId(A));
-	
-	// return value, S = S + FuncPtrs[ret.ID]
-	if (CallInst *CI = dyn_cast<CallInst>(V)) {
-		if (Function *CF = CI->getCalledFunction())
-			return mergeFuncSet(S, getRetId(CF));
 
+	GlobalID Id = 0;
+	if (Argument *A = dyn_cast<Argument>(V)) {
+		// arguement, Op = Op + FuncPtrs[arg.ID]
+		Id = Ctx->Ids.getArgId(A);
+	} else if (CallInst *CI = dyn_cast<CallInst>(V)) {
+		// return value, Op = Op + FuncPtrs[ret.ID]
 		// TODO: handle indirect calls
-		return false;
+		if (Function *CF = CI->getCalledFunction())
+			Id = Ctx->Ids.getRetId(CF);
+	} else if (LoadInst *L = dyn_cast<LoadInst>(V)) {
+		// loads, Op = Op + FuncPtrs[struct.ID]
+		Id = Ctx->Ids.getValueId(L);
+	} else if (!isa<Constant>(V) && !isa<InlineAsm>(V)
+	           && !isa<IntToPtrInst>(V)) {
+		// other constants (usually null), inline asm and inttoptr
+		// carry no functions
+		V->dump();
+		report_fatal_error("findFunctions: unhandled value type\n");
 	}
-	
-	// loads, S = S + FuncPtrs[struct.ID]
-	if (LoadInst *L = dyn_cast<LoadInst>(V))
-		return mergeFuncSet(S, getLoadStoreId(L));
-	
-	// ignore other constant (usually null), inline asm and inttoptr
-	if (isa<Constant>(V) || isa<InlineAsm>(V) || isa<IntToPtrInst>(V))
-		return false;
-		
-	V->dump();
-	report_fatal_error("findFunctions: unhandled value type\n");
-	return false;
+	if (Id)
+		Op.Srcs.push_back(Id);
 }
 
-bool CallGraphPass::runOnFunction(Function *F) {
-	bool Changed = false;
-
+// collect the constraints of function pointer assignments in F
+void CallGraphPass::extract(Function *F) {
 	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
 		Instruction *I = &*i;
 		if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
 			// stores to function pointers
 			Value *V = SI->getValueOperand();
 			if (isFunctionPointer(V->getType())) {
-				StringRef Id = getLoadStoreId(SI);
-				if (!Id.empty())
-					Changed |= findFunctions(V, Ctx->FuncPtrs[Id]);
+				GlobalID Id = Ctx->Ids.getValueId(SI);
+				if (!Id)
+					continue;
+				Operand Op;
+				SmallPtrSet<Value *, 4> Visited;
+				collect(V, Op, Visited);
+				addAssign(Id, Op);
 			}
 		} else if (ReturnInst *RI = dyn_cast<ReturnInst>(I)) {
 			// function returns
 			if (isFunctionPointer(F->getReturnType())) {
-				Value *V = RI->getReturnValue();
-				std::string Id = getRetId(F);
-				Changed |= findFunctions(V, Ctx->FuncPtrs[Id]);
+				Operand Op;
+				SmallPtrSet<Value *, 4> Visited;
+				collect(RI->getReturnValue(), Op, Visited);
+				addAssign(Ctx->Ids.getRetId(F), Op);
 			}
 		} else if (CallInst *CI = dyn_cast<CallInst>(I)) {
 			// ignore inline asm or intrinsic calls
@@ -165,32 +171,260 @@ bool CallGraphPass::runOnFunction(Function *F) {
 				continue;
 
 			// might be an indirect call, find all possible callees
-			FuncSet FS;
-			if (!findFunctions(CI->getCalledValue(), FS))
+			Operand Callee;
+			SmallPtrSet<Value *, 4> Visited;
+			collect(CI->getCalledValue(), Callee, Visited);
+			if (Callee.empty())
 				continue;
 
 			// looking for function pointer arguments
+			CallCons C;
 			for (unsigned no = 0; no != CI->getNumArgOperands(); ++no) {
 				Value *V = CI->getArgOperand(no);
 				if (!isFunctionPointer(V->getType()))
 					continue;
 
 				// find all possible assignments to the argument
-				FuncSet VS;
-				if (!findFunctions(V, VS))
-					continue;
+				C.Args.push_back(std::make_pair(no, Operand()));
+				SmallPtrSet<Value *, 4> ArgVisited;
+				collect(V, C.Args.back().second, ArgVisited);
+				if (C.Args.back().second.empty())
+					C.Args.pop_back();
+			}
+			if (C.Args.empty())
+				continue;
+			Calls.push_back(C);
+			addCall(Callee, Calls.size() - 1);
+		}
+	}
+}
 
-				// update argument FP-set for possible callees
-				for (FuncSet::iterator k = FS.begin(), ke = FS.end();
-				        k != ke; ++k) {
-					llvm::Function *CF = *k;
-					std::string Id = getArgId(CF, no);
-					Changed |= mergeFuncSet(Ctx->FuncPtrs[Id], VS);
-				}
+GlobalID CallGraphPass::find(GlobalID Id) {
+	if (Id >= Nodes.size())
+		Nodes.resize(Id + 1);
+	GlobalID Rep = Id;
+	while (Nodes[Rep].Rep)
+		Rep = Nodes[Rep].Rep;
+	// path compression
+	while (Nodes[Id].Rep && Nodes[Id].Rep != Rep) {
+		GlobalID Next = Nodes[Id].Rep;
+		Nodes[Id].Rep = Rep;
+		Id = Next;
+	}
+	return Rep;
+}
+
+// add S to the set of representative Rep and all IDs merged into it
+bool CallGraphPass::addFuncs(GlobalID Rep, const FuncSet &S) {
+	// S may live in FuncPtrs, which may move once Rep is added
+	FuncSet New;
+	if (const FuncSet *Old = Ctx->FuncPtrs.find(Rep))
+		New.intersectWithComplement(S, *Old);
+	else
+		New = S;
+	if (New.empty())
+		return false;
+
+	Ctx->FuncPtrs[Rep] |= New;
+	addWrite(Rep);
+	Updated = true;
+	Node &N = Nodes[Rep];
+	for (unsigned i = 0; i != N.Merged.size(); ++i) {
+		if (Ctx->FuncPtrs[N.Merged[i]] |= New)
+			addWrite(N.Merged[i]);
+	}
+	if (N.Pending.empty())
+		Worklist.push_back(Rep);
+	N.Pending |= New;
+	return true;
+}
+
+// FuncPtrs[Dst] includes FuncPtrs[Src] from now on
+void CallGraphPass::addEdge(GlobalID Src, GlobalID Dst) {
+	GlobalID S = find(Src), D = find(Dst);
+	if (S == D || !Nodes[S].Succs.insert(D).second)
+		return;
+	// later additions to S are pushed by solve()
+	if (const FuncSet *FS = Ctx->FuncPtrs.find(S))
+		addFuncs(D, *FS);
+}
+
+void CallGraphPass::addAssign(GlobalID Dst, const Operand &Op) {
+	// keep an entry even if nothing is assigned
+	Ctx->FuncPtrs[Dst];
+	addFuncs(find(Dst), Op.Funcs);
+	for (unsigned i = 0; i != Op.Srcs.size(); ++i) {
+		addRead(Op.Srcs[i]);
+		addEdge(Op.Srcs[i], Dst);
+	}
+}
+
+void CallGraphPass::addCall(const Operand &Callee, unsigned c) {
+	resolve(c, Callee.Funcs);
+	for (unsigned i = 0; i != Callee.Srcs.size(); ++i) {
+		addRead(Callee.Srcs[i]);
+		GlobalID R = find(Callee.Srcs[i]);
+		Nodes[R].Calls.push_back(c);
+		if (const FuncSet *FS = Ctx->FuncPtrs.find(R))
+			resolve(c, *FS);
+	}
+}
+
+// connect call c to callees in S not seen before
+void CallGraphPass::resolve(unsigned c, const FuncSet &S) {
+	FuncSet New;
+	New.intersectWithComplement(S, Calls[c].Resolved);
+	Calls[c].Resolved |= New;
+	for (FuncSet::iterator i = New.begin(), e = New.end(); i != e; ++i)
+		connect(c, *i);
+}
+
+// pass the function pointer arguments of call c to Callee
+void CallGraphPass::connect(unsigned c, FuncID Callee) {
+	const CallCons &C = Calls[c];
+	for (unsigned i = 0; i != C.Args.size(); ++i)
+		addAssign(Ctx->FuncTab.getArgId(Callee, C.Args[i].first),
+		          C.Args[i].second);
+}
+
+// merge representative From into To
+void CallGraphPass::unite(GlobalID From, GlobalID To) {
+	Node &F = Nodes[From], &T = Nodes[To];
+	F.Rep = To;
+	T.Merged.push_back(From);
+	T.Merged.insert(T.Merged.end(), F.Merged.begin(), F.Merged.end());
+	T.Succs.insert(F.Succs.begin(), F.Succs.end());
+	T.Calls.insert(T.Calls.end(), F.Calls.begin(), F.Calls.end());
+	std::vector<GlobalID>().swap(F.Merged);
+	IdSet().swap(F.Succs);
+	std::vector<unsigned>().swap(F.Calls);
+	F.Pending.clear();
+
+	// all members share the union, which is pushed again in full,
+	// since edges and calls of either side missed part of it
+	FuncSet U = Ctx->FuncPtrs[To];
+	mergeFuncSet(U, Ctx->FuncPtrs[From]);
+	if (mergeFuncSet(Ctx->FuncPtrs[To], U)) {
+		addWrite(To);
+		Updated = true;
+	}
+	for (unsigned i = 0; i != T.Merged.size(); ++i) {
+		if (mergeFuncSet(Ctx->FuncPtrs[T.Merged[i]], U))
+			addWrite(T.Merged[i]);
+	}
+	if (T.Pending.empty())
+		Worklist.push_back(To);
+	T.Pending |= U;
+}
+
+namespace {
+
+// a node on the DFS path of collapseCycles
+struct Frame {
+	GlobalID Id;
+	std::vector<GlobalID> Succs;
+	unsigned Next;
+};
+
+} // anonymous namespace
+
+// collapse the cycles reachable from Start (Tarjan's algorithm)
+void CallGraphPass::collapseCycles(GlobalID Start) {
+	DenseMap<GlobalID, unsigned> Index, Low;
+	DenseSet<GlobalID> OnStack;
+	std::vector<GlobalID> Stack;
+	std::vector<Frame> Path;
+
+	Start = find(Start);
+	Path.push_back(Frame());
+	Path.back().Id = Start;
+	Path.back().Next = 0;
+	while (!Path.empty()) {
+		Frame &Top = Path.back();
+		GlobalID V = Top.Id;
+		if (!Index.count(V)) {
+			unsigned N = Index.size();
+			Index[V] = N;
+			Low[V] = N;
+			Stack.push_back(V);
+			OnStack.insert(V);
+			const IdSet &S = Nodes[V].Succs;
+			Top.Succs.assign(S.begin(), S.end());
+		}
+		if (Top.Next != Top.Succs.size()) {
+			GlobalID W = find(Top.Succs[Top.Next++]);
+			if (W == V)
+				continue;
+			if (!Index.count(W)) {
+				Path.push_back(Frame());
+				Path.back().Id = W;
+				Path.back().Next = 0;
+			} else if (OnStack.count(W)) {
+				Low[V] = std::min(Low[V], Index[W]);
 			}
+			continue;
+		}
+
+		Path.pop_back();
+		if (!Path.empty()) {
+			GlobalID P = Path.back().Id;
+			Low[P] = std::min(Low[P], Low[V]);
+		}
+		if (Low[V] != Index[V])
+			continue;
+		// V is the root of a strongly connected component
+		for (;;) {
+			GlobalID W = Stack.back();
+			Stack.pop_back();
+			OnStack.erase(W);
+			if (W == V)
+				break;
+			unite(W, V);
+		}
+	}
+}
+
+// propagate pending functions until a fixpoint is reached
+void CallGraphPass::solve() {
+	while (!Worklist.empty()) {
+		GlobalID R = find(Worklist.back());
+		Worklist.pop_back();
+		if (Nodes[R].Pending.empty())
+			continue;
+		FuncSet Diff(Nodes[R].Pending);
+		Nodes[R].Pending.clear();
+
+		// new callees of calls through R
+		std::vector<unsigned> RCalls(Nodes[R].Calls);
+		for (unsigned i = 0; i != RCalls.size(); ++i)
+			resolve(RCalls[i], Diff);
+
+		std::vector<GlobalID> Succs(Nodes[R].Succs.begin(),
+		                            Nodes[R].Succs.end());
+		for (unsigned i = 0; i != Succs.size(); ++i) {
+			GlobalID D = find(Succs[i]);
+			if (D == R)
+				continue;
+			addFuncs(D, Diff);
+
+			// lazy cycle detection: equal sets suggest a cycle
+			if (*Ctx->FuncPtrs.find(R) != *Ctx->FuncPtrs.find(D)
+			    || !Checked.insert(std::make_pair(R, D)).second)
+				continue;
+			collapseCycles(D);
+			GlobalID NewR = find(R);
+			if (NewR == R && Nodes[R].Pending.empty()) {
+				// no cycle through R; the edges of nodes merged
+				// into D are pushed with its union
+				continue;
+			}
+			// R has been merged, or has gained edges; push Diff again
+			if (Nodes[NewR].Pending.empty())
+				Worklist.push_back(NewR);
+			Nodes[NewR].Pending |= Diff;
+			break;
 		}
 	}
-	return Changed;
 }
 
 bool CallGraphPass::doInitialization(Module *M) {
@@ -203,50 +437,188 @@ bool CallGraphPass::doInitialization(Module *M) {
 
 	// collect global function definitions
 	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
-		if (f->hasExternalLinkage() && !f->empty())
-			Ctx->Funcs[f->getName()] = &*f;
+		if (f->hasExternalLinkage() && hasBody(&*f))
+			Ctx->FuncTab.setDefinition(f->getName(), Ctx->FuncTab.get(&*f));
 	}
 
 	return true;
 }
 
 bool CallGraphPass::doFinalization(Module *M) {
+	Finalized = true;
+	addCallees(M);
+	return false;
+}
+
+void CallGraphPass::moduleLoaded(unsigned Index, Module *M) {
+	if (Finalized)
+		addCallees(M);
+}
+
+void CallGraphPass::addCallees(Module *M) {
 	// update callee mapping
 	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
 		Function *F = &*f;
+		if (F->empty())
+			continue;
+		FuncSet All;
 		for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
 			// map callsite to possible callees
 			if (CallInst *CI = dyn_cast<CallInst>(&*i)) {
 				FuncSet &FS = Ctx->Callees[CI];
 				findFunctions(CI->getCalledValue(), FS);
+				if (!CI->isInlineAsm())
+					All |= FS;
 			}
 		}
+		FuncID Id = Ctx->FuncTab.get(F);
+		Ctx->Order.addCalls(Id, Ctx->FuncTab[Id].Module, All);
 	}
-	return false;
+}
+
+void CallGraphPass::run(ModuleList &modules, bool Finalize) {
+	IterativeModulePass::run(modules, Finalize);
+	// callees of all modules have been added by doFinalization
+	if (Finalize)
+		Ctx->Order.compute();
 }
 
 bool CallGraphPass::doModulePass(Module *M) {
-	bool Changed = true, ret = false;
-	while (Changed) {
-		Changed = false;
-		for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i)
-			Changed |= runOnFunction(&*i);
-		ret |= Changed;
+	// constraints of a module do not change; later visits only find
+	// changes made through other modules, which are already solved
+	unsigned m = getCurrentModule();
+	if (m >= Extracted.size())
+		Extracted.resize(m + 1);
+	if (Extracted[m])
+		return false;
+	Extracted[m] = true;
+
+	Updated = false;
+	for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i)
+		extract(&*i);
+	solve();
+	return Updated;
+}
+
+void CallOrder::addCalls(FuncID F, unsigned m, const FuncSet &Callees) {
+	if (F >= Succs.size()) {
+		Succs.resize(F + 1);
+		Modules.resize(F + 1, -1);
 	}
-	return ret;
+	Succs[F] |= Callees;
+	Modules[F] = m;
+}
+
+// Tarjan's algorithm, which finds components callees first
+void CallOrder::compute() {
+	static const FuncSet Empty;
+	// callees without bodies are not recorded
+	unsigned n = Succs.size();
+	for (unsigned i = 0; i != Succs.size(); ++i)
+		for (FuncSet::iterator j = Succs[i].begin(), je = Succs[i].end();
+		     j != je; ++j)
+			n = std::max(n, *j + 1);
+	SCCs.assign(n, 0);
+	Recursive.assign(n, false);
+	NumSCCs = 0;
+
+	const unsigned Unvisited = ~0U;
+	std::vector<unsigned> Index(n, Unvisited), Low(n, 0);
+	std::vector<bool> OnStack(n, false);
+	std::vector<FuncID> Stack;
+	// DFS path of (function, next successor)
+	std::vector<std::pair<FuncID, FuncSet::iterator> > Path;
+	unsigned Next = 0;
+
+	for (FuncID Root = 0; Root != n; ++Root) {
+		if (Index[Root] != Unvisited)
+			continue;
+		Index[Root] = Low[Root] = Next++;
+		Stack.push_back(Root);
+		OnStack[Root] = true;
+		const FuncSet &RS = Root < Succs.size() ? Succs[Root] : Empty;
+		Path.push_back(std::make_pair(Root, RS.begin()));
+
+		while (!Path.empty()) {
+			FuncID V = Path.back().first;
+			const FuncSet &VS = V < Succs.size() ? Succs[V] : Empty;
+			FuncSet::iterator &It = Path.back().second;
+			if (It != VS.end()) {
+				FuncID W = *It;
+				++It;
+				if (W == V)
+					Recursive[V] = true;
+				if (Index[W] == Unvisited) {
+					Index[W] = Low[W] = Next++;
+					Stack.push_back(W);
+					OnStack[W] = true;
+					const FuncSet &WS = W < Succs.size() ? Succs[W] : Empty;
+					Path.push_back(std::make_pair(W, WS.begin()));
+				} else if (OnStack[W]) {
+					Low[V] = std::min(Low[V], Index[W]);
+				}
+				continue;
+			}
+
+			Path.pop_back();
+			if (!Path.empty()) {
+				FuncID P = Path.back().first;
+				Low[P] = std::min(Low[P], Low[V]);
+			}
+			if (Low[V] != Index[V])
+				continue;
+			// V is the root of a component
+			bool Multi = Stack.back() != V;
+			for (;;) {
+				FuncID W = Stack.back();
+				Stack.pop_back();
+				OnStack[W] = false;
+				SCCs[W] = NumSCCs;
+				if (Multi)
+					Recursive[W] = true;
+				if (W == V)
+					break;
+			}
+			++NumSCCs;
+		}
+	}
+}
+
+void CallOrder::getModuleOrder(unsigned n, bool CallersFirst,
+                               std::vector<unsigned> &Order) const {
+	// position of the first component of each module
+	std::vector<std::pair<unsigned, unsigned> > Keys;
+	for (unsigned m = 0; m != n; ++m)
+		Keys.push_back(std::make_pair(~0U, m));
+	for (FuncID F = 0; F != Modules.size(); ++F) {
+		int m = Modules[F];
+		if (m < 0 || (unsigned)m >= n)
+			continue;
+		unsigned Pos = CallersFirst ? NumSCCs - SCCs[F] : SCCs[F];
+		Keys[m].first = std::min(Keys[m].first, Pos);
+	}
+	std::sort(Keys.begin(), Keys.end());
+	Order.clear();
+	for (unsigned i = 0; i != n; ++i)
+		Order.push_back(Keys[i].second);
 }
 
 // debug
 void CallGraphPass::dumpFuncPtrs() {
 	raw_ostream &OS = dbgs();
-	for (FuncPtrMap::iterator i = Ctx->FuncPtrs.begin(), 
-		 e = Ctx->FuncPtrs.end(); i != e; ++i) {
-		OS << i->first << "\n";
-		FuncSet &v = i->second;
+	std::vector<GlobalID> Ids;
+	for (GlobalID i = 1, e = Ctx->FuncPtrs.bound(); i != e; ++i)
+		if (Ctx->FuncPtrs.count(i))
+			Ids.push_back(i);
+	Ctx->Ids.sort(Ids);
+	for (unsigned i = 0; i != Ids.size(); ++i) {
+		OS << Ctx->Ids.getName(Ids[i]) << "\n";
+		const FuncSet &v = *Ctx->FuncPtrs.find(Ids[i]);
 		for (FuncSet::iterator j = v.begin(), ej = v.end();
 			 j != ej; ++j) {
-			OS << "  " << ((*j)->hasInternalLinkage() ? "f" : "F")
-				<< " " << (*j)->getName() << "\n";
+			const FuncInfo &FI = Ctx->FuncTab[*j];
+			OS << "  " << (FI.hasInternalLinkage ? "f" : "F")
+				<< " " << FI.Name << "\n";
 		}
 	}
 }
@@ -264,8 +636,9 @@ void CallGraphPass::dumpCallees() {
 		CI->dump();
 		for (FuncSet::iterator j = v.begin(), ej = v.end();
 			 j != ej; ++j) {
-			OS << "         " << ((*j)->hasInternalLinkage() ? "f" : "F")
-				<< " " << (*j)->getName() << "\n";
+			const FuncInfo &FI = Ctx->FuncTab[*j];
+			OS << "         " << (FI.hasInternalLinkage ? "f" : "F")
+				<< " " << FI.Name << "\n";
 		}
 	}
 }
@@ -57,26 +57,49 @@ private:
 
 } // anonymous namespace
 
+// Look up the result in the query cache first.
+static SMTStatus query(SMTSolver &SMT, SMTExpr Query) {
+	uint64_t Check;
+	uint64_t Key = SMT.hash(Query, &Check);
+	int Res;
+	if (SMTCacheLookup(Key, Check, &Res))
+		return (SMTStatus)Res;
+	Res = SMT.query(Query);
+	SMTCacheInsert(Key, Check, Res);
+	return (SMTStatus)Res;
+}
+
 void CmpSat::check(BranchInst *I) {
 	BasicBlock *BB = I->getParent();
 	Value *V = I->getCondition();
-	SMTSolver SMT(false);
-	ValueGen VG(*DL, SMT);
-	PathGen PG(VG, Backedges, *DT);
-	SMTExpr ValuePred = VG.get(V);
-	SMTExpr PathPred = PG.get(BB);
-	SMTExpr Query = SMT.bvand(ValuePred, PathPred);
-	SMTStatus Status = SMT.query(Query);
-	SMT.decref(Query);
+	OwningPtr<SMTSolver> SMT(SMTSolver::create(false));
+	OwningPtr<ValueGen> VG(new ValueGen(*DL, *SMT));
+	OwningPtr<PathGen> PG(new PathGen(*VG, Backedges, *DT));
+	SMTExpr ValuePred = VG->get(V);
+	SMTExpr PathPred = PG->get(BB);
+	SMTExpr Query = SMT->bvand(ValuePred, PathPred);
+	SMTStatus Status = query(*SMT, Query);
+	SMT->decref(Query);
 	CmpStatus Reason = 0;
 	if (Status == SMT_UNSAT) {
 		Reason = CMP_FALSE;
 	} else {
-		SMTExpr NotValuePred = SMT.bvnot(ValuePred);
-		Query = SMT.bvand(NotValuePred, PathPred);
-		Status = SMT.query(Query);
-		SMT.decref(Query);
-		SMT.decref(NotValuePred);
+		// A stopped solver may not answer again; release expressions
+		// before their solver and build them anew.
+		if (SMT->interrupted() && !SMT->resumable()) {
+			PG.reset();
+			VG.reset();
+			SMT.reset(SMTSolver::create(false));
+			VG.reset(new ValueGen(*DL, *SMT));
+			PG.reset(new PathGen(*VG, Backedges, *DT));
+			ValuePred = VG->get(V);
+			PathPred = PG->get(BB);
+		}
+		SMTExpr NotValuePred = SMT->bvnot(ValuePred);
+		Query = SMT->bvand(NotValuePred, PathPred);
+		Status = query(*SMT, Query);
+		SMT->decref(Query);
+		SMT->decref(NotValuePred);
 		if (Status == SMT_UNSAT)
 			Reason = CMP_TRUE;
 	}
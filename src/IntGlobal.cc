@@ -14,18 +14,29 @@
 #include "llvm/Analysis/Verifier.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/SystemUtils.h"
 #include "llvm/Support/IRReader.h"
+#include "llvm/Support/InstIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/system_error.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Threading.h"
+#include <algorithm>
 #include <memory>
 #include <vector>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "IntGlobal.h"
 #include "Annotation.h"
+#include "Sidecar.h"
+#include "Stats.h"
+#include "SummaryDB.h"
 
 using namespace llvm;
 
@@ -39,64 +50,1190 @@ Verbose("v", cl::desc("Print information about actions taken"));
 static cl::opt<bool>
 NoWriteback("p", cl::desc("Do not writeback annotated bytecode"));
 
+static cl::opt<bool>
+UseSidecar("sidecar", cl::desc("Write results to <file>.kint instead of "
+                               "rewriting bytecode"));
+
+static cl::opt<std::string>
+SummaryFile("db", cl::desc("Summary database for incremental analysis"),
+            cl::value_desc("file"));
+
+static cl::opt<unsigned>
+NumThreads("j", cl::desc("Number of threads for loading and analyzing "
+                         "modules (default: number of CPUs)"),
+           cl::value_desc("threads"), cl::init(0));
+
+static cl::opt<bool>
+ParallelPasses("parallel-passes", cl::desc("Visit the modules of each round "
+                                           "of the global passes in parallel"));
+
+static cl::opt<unsigned>
+MemLimit("mem-limit", cl::desc("Keep parsed modules within this size of "
+                               "input files, reloading evicted modules on "
+                               "demand (default: no limit)"),
+         cl::value_desc("MB"), cl::init(0));
+
+static cl::opt<std::string>
+StatsFile("stats", cl::desc("Write performance statistics as JSON"),
+          cl::value_desc("file"));
+
 ModuleList Modules;
+std::vector<uint64_t> ModuleHashes;
 GlobalContext GlobalCtx;
 
+// NULL unless -stats is given
+static RunStats *Stats = NULL;
+
 #define Diag if (Verbose) llvm::errs()
 
+// Serialize diagnostics of worker threads
+static pthread_mutex_t DiagLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void parallelFor(unsigned Size, void (*Fn)(unsigned, void *), void *Arg);
+
 void doWriteback(Module *M, StringRef name)
 {
 	std::string err;
 	OwningPtr<tool_output_file> out(
 		new tool_output_file(name.data(), err, raw_fd_ostream::F_Binary));
 	if (!err.empty()) {
+		pthread_mutex_lock(&DiagLock);
 		Diag << "Cannot write back to " << name << ": " << err << "\n";
+		pthread_mutex_unlock(&DiagLock);
 		return;
 	}
-	M->print(out->os(), NULL);
+	// keep the format of the input
+	if (M->getMaterializer())
+		WriteBitcodeToFile(M, out->os());
+	else
+		M->print(out->os(), NULL);
 	out->keep();
 }
 
 
-void IterativeModulePass::run(ModuleList &modules) {
+static Module *getParentModule(Value *V) {
+	if (Instruction *I = dyn_cast<Instruction>(V))
+		return I->getParent()->getParent()->getParent();
+	if (Argument *A = dyn_cast<Argument>(V))
+		return A->getParent()->getParent();
+	if (GlobalValue *GV = dyn_cast<GlobalValue>(V))
+		return GV->getParent();
+	return NULL;
+}
+
+IdTable::IdTable(IdTable *Shared_) : Shared(Shared_) {
+	pthread_mutex_init(&Lock, NULL);
+	Names.push_back(StringRef());
+}
+
+IdTable::~IdTable() {
+	pthread_mutex_destroy(&Lock);
+}
+
+GlobalID IdTable::get(StringRef Name) {
+	if (Name.empty())
+		return 0;
+	if (Shared)
+		return Shared->get(Name);
+	pthread_mutex_lock(&Lock);
+	StringMapEntry<GlobalID> &Entry = Map.GetOrCreateValue(Name, 0);
+	if (!Entry.getValue()) {
+		Entry.setValue(Names.size());
+		Names.push_back(Entry.getKey());
+	}
+	GlobalID Id = Entry.getValue();
+	pthread_mutex_unlock(&Lock);
+	return Id;
+}
+
+StringRef IdTable::getName(GlobalID Id) const {
+	if (Shared)
+		return Shared->getName(Id);
+	pthread_mutex_lock(&Lock);
+	StringRef Name = Names[Id];
+	pthread_mutex_unlock(&Lock);
+	return Name;
+}
+
+GlobalID IdTable::bound() const {
+	if (Shared)
+		return Shared->bound();
+	pthread_mutex_lock(&Lock);
+	GlobalID Bound = Names.size();
+	pthread_mutex_unlock(&Lock);
+	return Bound;
+}
+
+namespace {
+struct IdNameLess {
+	const IdTable &Ids;
+	IdNameLess(const IdTable &Ids) : Ids(Ids) { }
+	bool operator()(GlobalID L, GlobalID R) const {
+		return Ids.getName(L) < Ids.getName(R);
+	}
+};
+}
+
+void IdTable::sort(std::vector<GlobalID> &V) const {
+	std::sort(V.begin(), V.end(), IdNameLess(*this));
+}
+
+GlobalID IdTable::getValueId(Value *V) {
+	if (!isa<Argument>(V) && !isa<CallInst>(V)
+	    && !isa<LoadInst>(V) && !isa<StoreInst>(V))
+		return 0;
+	DenseMap<Value *, GlobalID> &ValueIds = Caches[getParentModule(V)].ValueIds;
+	DenseMap<Value *, GlobalID>::iterator it = ValueIds.find(V);
+	if (it != ValueIds.end())
+		return it->second;
+	GlobalID Id = get(::getValueId(V));
+	ValueIds[V] = Id;
+	return Id;
+}
+
+GlobalID IdTable::getArgId(Argument *A) {
+	return getArgId(A->getParent(), A->getArgNo());
+}
+
+GlobalID IdTable::getArgId(Function *F, unsigned no) {
+	DenseMap<std::pair<Function *, unsigned>, GlobalID> &ArgIds
+		= Caches[F->getParent()].ArgIds;
+	std::pair<Function *, unsigned> Key(F, no);
+	DenseMap<std::pair<Function *, unsigned>, GlobalID>::iterator it
+		= ArgIds.find(Key);
+	if (it != ArgIds.end())
+		return it->second;
+	GlobalID Id = get(::getArgId(F, no));
+	ArgIds[Key] = Id;
+	return Id;
+}
+
+GlobalID IdTable::getRetId(Function *F) {
+	DenseMap<Function *, GlobalID> &RetIds = Caches[F->getParent()].RetIds;
+	DenseMap<Function *, GlobalID>::iterator it = RetIds.find(F);
+	if (it != RetIds.end())
+		return it->second;
+	GlobalID Id = get(::getRetId(F));
+	RetIds[F] = Id;
+	return Id;
+}
+
+GlobalID IdTable::getRetId(CallInst *CI) {
+	if (Function *CF = CI->getCalledFunction())
+		return getRetId(CF);
+	// for indirect calls, the value ID is the return ID
+	return getValueId(CI);
+}
+
+void IdTable::forget(Module *M) {
+	Caches.erase(M);
+}
+
+FuncTable::FuncTable(IdTable *Ids_, FuncTable *Shared_)
+	: Ids(Ids_), Shared(Shared_), Infos(1) {
+	pthread_mutex_init(&Lock, NULL);
+}
+
+FuncTable::~FuncTable() {
+	pthread_mutex_destroy(&Lock);
+}
+
+// called with Lock held
+FuncID FuncTable::add(unsigned Index, Function *F) {
+	std::string Key = (Twine(Index) + ":" + F->getName()).str();
+	StringMapEntry<FuncID> &Entry = Map.GetOrCreateValue(Key, 0);
+	if (!Entry.getValue()) {
+		Entry.setValue(Infos.size());
+		Infos.push_back(FuncInfo());
+		FuncInfo &Info = Infos.back();
+		Info.Name = Entry.getKey().substr(Key.size() - F->getName().size());
+		Info.Scope = getScopeName(F);
+		Info.Module = Index;
+		Info.isDeclaration = !hasBody(F);
+		Info.isVarArg = F->isVarArg();
+		Info.hasInternalLinkage = F->hasInternalLinkage();
+		Info.RetId = 0;
+	}
+	Cache[F] = Entry.getValue();
+	return Entry.getValue();
+}
+
+void FuncTable::addModule(unsigned Index, Module *M) {
+	pthread_mutex_lock(&Lock);
+	ModuleIndex[M] = Index;
+	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f)
+		add(Index, &*f);
+	pthread_mutex_unlock(&Lock);
+}
+
+void FuncTable::removeModule(Module *M) {
+	pthread_mutex_lock(&Lock);
+	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f)
+		Cache.erase(&*f);
+	ModuleIndex.erase(M);
+	pthread_mutex_unlock(&Lock);
+}
+
+FuncID FuncTable::get(Function *F) {
+	if (Shared)
+		return Shared->get(F);
+	pthread_mutex_lock(&Lock);
+	FuncID Id;
+	DenseMap<Function *, FuncID>::iterator it = Cache.find(F);
+	if (it != Cache.end()) {
+		Id = it->second;
+	} else {
+		// declarations added after the module was registered
+		DenseMap<Module *, unsigned>::iterator mi =
+			ModuleIndex.find(F->getParent());
+		assert(mi != ModuleIndex.end() && "Module not registered!");
+		Id = add(mi->second, F);
+	}
+	pthread_mutex_unlock(&Lock);
+	return Id;
+}
+
+FuncID FuncTable::get(unsigned Module, StringRef Name) const {
+	if (Shared)
+		return Shared->get(Module, Name);
+	std::string Key = (Twine(Module) + ":" + Name).str();
+	pthread_mutex_lock(&Lock);
+	StringMap<FuncID>::const_iterator it = Map.find(Key);
+	FuncID Id = it != Map.end() ? it->second : 0;
+	pthread_mutex_unlock(&Lock);
+	return Id;
+}
+
+const FuncInfo &FuncTable::operator[](FuncID Id) const {
+	if (Shared)
+		return (*Shared)[Id];
+	pthread_mutex_lock(&Lock);
+	const FuncInfo &Info = Infos[Id];
+	pthread_mutex_unlock(&Lock);
+	return Info;
+}
+
+GlobalID FuncTable::getRetId(FuncID Id) {
+	if (Shared)
+		return Shared->getRetId(Id);
+	pthread_mutex_lock(&Lock);
+	FuncInfo &Info = Infos[Id];
+	if (!Info.RetId)
+		Info.RetId = Ids->get("ret." + Info.Scope);
+	GlobalID RetId = Info.RetId;
+	pthread_mutex_unlock(&Lock);
+	return RetId;
+}
+
+GlobalID FuncTable::getArgId(FuncID Id, unsigned no) {
+	if (Shared)
+		return Shared->getArgId(Id, no);
+	pthread_mutex_lock(&Lock);
+	std::vector<GlobalID> &V = Infos[Id].ArgIds;
+	if (no >= V.size())
+		V.resize(no + 1, 0);
+	if (!V[no])
+		V[no] = Ids->get("arg." + Infos[Id].Scope + "." + Twine(no).str());
+	GlobalID ArgId = V[no];
+	pthread_mutex_unlock(&Lock);
+	return ArgId;
+}
+
+void FuncTable::setDefinition(StringRef Name, FuncID Id) {
+	pthread_mutex_lock(&Lock);
+	Defs[Name] = Id;
+	pthread_mutex_unlock(&Lock);
+}
+
+FuncID FuncTable::getDefinition(StringRef Name) const {
+	if (Shared)
+		return Shared->getDefinition(Name);
+	pthread_mutex_lock(&Lock);
+	StringMap<FuncID>::const_iterator it = Defs.find(Name);
+	FuncID Id = it != Defs.end() ? it->second : 0;
+	pthread_mutex_unlock(&Lock);
+	return Id;
+}
+
+bool DescSet::insert(unsigned D) {
+	if (D < NumBits) {
+		uint64_t Bit = uint64_t(1) << D;
+		if (Bits & Bit)
+			return false;
+		Bits |= Bit;
+		return true;
+	}
+	std::vector<unsigned>::iterator it
+		= std::lower_bound(Spill.begin(), Spill.end(), D);
+	if (it != Spill.end() && *it == D)
+		return false;
+	Spill.insert(it, D);
+	return true;
+}
+
+bool DescSet::insert(const DescSet &RHS) {
+	uint64_t Old = Bits;
+	Bits |= RHS.Bits;
+	bool Grew = Bits != Old;
+	for (unsigned i = 0; i != RHS.Spill.size(); ++i)
+		Grew |= insert(RHS.Spill[i]);
+	return Grew;
+}
+
+void DescSet::getIndices(std::vector<unsigned> &V) const {
+	for (uint64_t B = Bits; B; B &= B - 1)
+		V.push_back(CountTrailingZeros_64(B));
+	V.insert(V.end(), Spill.begin(), Spill.end());
+}
+
+TaintMap::TaintMap() : Shared(NULL) {
+	pthread_mutex_init(&Lock, NULL);
+}
+
+TaintMap::~TaintMap() {
+	pthread_mutex_destroy(&Lock);
+}
+
+unsigned TaintMap::intern(StringRef D) {
+	if (Shared)
+		return Shared->intern(D);
+	pthread_mutex_lock(&Lock);
+	StringMapEntry<unsigned> &E = DescIndex.GetOrCreateValue(D, ~0U);
+	if (E.getValue() == ~0U) {
+		E.setValue(Descs.size());
+		Descs.push_back(E.getKey());
+	}
+	unsigned Index = E.getValue();
+	pthread_mutex_unlock(&Lock);
+	return Index;
+}
+
+StringRef TaintMap::getDesc(unsigned Index) const {
+	if (Shared)
+		return Shared->getDesc(Index);
+	pthread_mutex_lock(&Lock);
+	StringRef D = Descs[Index];
+	pthread_mutex_unlock(&Lock);
+	return D;
+}
+
+std::string TaintMap::toString(const DescSet &D) const {
+	std::vector<unsigned> Indices;
+	D.getIndices(Indices);
+	std::vector<StringRef> Names;
+	for (unsigned i = 0; i != Indices.size(); ++i)
+		Names.push_back(getDesc(Indices[i]));
+	std::sort(Names.begin(), Names.end());
+	std::string s;
+	for (unsigned i = 0; i != Names.size(); ++i) {
+		if (i)
+			s += ", ";
+		s += Names[i].str();
+	}
+	return s;
+}
+
+DescSet &TaintMap::getEntry(Value *V) {
+	std::pair<ValueMap::iterator, bool> Entry
+		= VTS.insert(std::make_pair(V, DescSet()));
+	if (Entry.second)
+		ModuleValues[getParentModule(V)].push_back(V);
+	return Entry.first->second;
+}
+
+void TaintMap::forget(Module *M) {
+	// values outside of any module may refer to M as well
+	Module *Keys[] = { M, NULL };
+	for (unsigned k = 0; k != 2; ++k) {
+		std::map<Module *, std::vector<Value *> >::iterator it
+			= ModuleValues.find(Keys[k]);
+		if (it == ModuleValues.end())
+			continue;
+		for (unsigned i = 0; i != it->second.size(); ++i)
+			VTS.erase(it->second[i]);
+		ModuleValues.erase(it);
+	}
+}
+
+void TaintMap::takeValues(ValueMap &Out) {
+	Out.swap(VTS);
+	VTS.clear();
+	ModuleValues.clear();
+}
+
+GlobalContext::GlobalContext(GlobalContext *Base_)
+	: Base(Base_), Ids(&Base_->Ids), FuncTab(&Ids, &Base_->FuncTab),
+	  IntRanges(CRange(1, false)), RawRanges(CRange(1, false)) {
+	FuncPtrs.setBase(&Base->FuncPtrs);
+	Taints.GTS.setBase(&Base->Taints.GTS);
+	Taints.shareDescs(&Base->Taints);
+	IntRanges.setBase(&Base->IntRanges);
+	RawRanges.setBase(&Base->RawRanges);
+}
+
+void GlobalContext::moduleLoaded(unsigned Index, Module *M) {
+	FuncTab.addModule(Index, M);
+}
+
+void GlobalContext::moduleEvicted(unsigned Index, Module *M) {
+	Ids.forget(M);
+	FuncTab.removeModule(M);
+	Taints.forget(M);
+	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
+		Function *F = &*f;
+		for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i)
+			if (CallInst *CI = dyn_cast<CallInst>(&*i))
+				Callees.erase(CI);
+	}
+}
+
+const FuncSet *GlobalContext::getCallees(CallInst *CI) const {
+	const CalleeMap &C = Base ? Base->Callees : Callees;
+	CalleeMap::const_iterator it = C.find(CI);
+	if (it != C.end())
+		return &it->second;
+	return NULL;
+}
+
+void GlobalContext::takeDelta(Delta &D) {
+	FuncPtrs.swap(D.FuncPtrs);
+	Taints.GTS.swap(D.GTS);
+	Taints.takeValues(D.VTS);
+	IntRanges.swap(D.IntRanges);
+	RawRanges.swap(D.RawRanges);
+}
+
+void GlobalContext::mergeDelta(Delta &D, IdSet &Changed) {
+	for (GlobalID i = 1, e = D.FuncPtrs.bound(); i < e; ++i) {
+		const FuncSet *S = D.FuncPtrs.find(i);
+		if (!S)
+			continue;
+		if (FuncPtrs[i] |= *S)
+			Changed.insert(i);
+	}
+	// views share descriptions, so their sets are merged as they are
+	for (GlobalID i = 1, e = D.GTS.bound(); i < e; ++i) {
+		const std::pair<DescSet, bool> *T = D.GTS.find(i);
+		if (T && Taints.add(i, T->first, T->second))
+			Changed.insert(i);
+	}
+	for (TaintMap::ValueMap::iterator i = D.VTS.begin(), e = D.VTS.end();
+	     i != e; ++i)
+		Taints.add(i->first, i->second);
+	for (GlobalID i = 1, e = D.IntRanges.bound(); i < e; ++i) {
+		const CRange *R = D.IntRanges.find(i);
+		if (!R)
+			continue;
+		if (IntRanges.insert(i, *R) || IntRanges[i].safeUnion(*R))
+			Changed.insert(i);
+	}
+	for (GlobalID i = 1, e = D.RawRanges.bound(); i < e; ++i) {
+		const CRange *R = D.RawRanges.find(i);
+		if (R && !RawRanges.insert(i, *R))
+			RawRanges[i].safeUnion(*R);
+	}
+}
+
+void IterativeModulePass::addRead(GlobalID Id) {
+	if (Id)
+		Deps[CurModule].Reads.insert(Id);
+}
+
+void IterativeModulePass::addWrite(GlobalID Id) {
+	if (Id)
+		Changed.insert(Id);
+}
+
+void IterativeModulePass::addReaders(unsigned m, const IdSet &Reads) {
+	for (IdSet::const_iterator j = Reads.begin(), je = Reads.end(); j != je; ++j) {
+		if (*j >= Readers.size())
+			Readers.resize(*j + 1);
+		Readers[*j].insert(m);
+	}
+}
+
+// Schedule other modules reading IDs changed by the visit of module m;
+// m itself has already reached its local fixpoint
+void IterativeModulePass::scheduleReaders(unsigned m, bool ret, bool Recorded,
+                                          std::vector<bool> &Dirty) {
+	unsigned n = Dirty.size();
+	// a pass that does not record its writes, conservatively
+	// revisit all other modules
+	if (ret && !Recorded) {
+		Dirty.assign(n, true);
+		Dirty[m] = false;
+	}
+
+	ModuleSummary &D = Deps[m];
+	for (IdSet::iterator j = Changed.begin(), je = Changed.end(); j != je; ++j) {
+		D.Writes.insert(*j);
+		if (*j >= Readers.size())
+			continue;
+		ModuleSet &R = Readers[*j];
+		for (ModuleSet::iterator k = R.begin(), ke = R.end(); k != ke; ++k)
+			if (*k != m && !isSettled(*k))
+				Dirty[*k] = true;
+	}
+}
+
+// A pass on its own view of the global context, reused by worker
+// threads across the rounds of a pass
+struct IterativeModulePass::Worker {
+	GlobalContext View;
+	OwningPtr<IterativeModulePass> Pass;
+
+	Worker(IterativeModulePass *P) : View(P->Ctx), Pass(P->clone(&View)) {
+		// dependencies of the module being visited only
+		Pass->Deps.resize(1);
+	}
+};
+
+// Modules of a parallel round are visited in batches of this size, so
+// that only one batch of bodies has to be in memory at a time.  The
+// size does not depend on the number of threads, nor do the results.
+static const unsigned ParallelBatch = 64;
+
+// A batch of modules visited in parallel.  Each visit sees the facts as
+// of the beginning of the batch; its updates are merged afterwards.
+struct IterativeModulePass::Round {
+	struct Result {
+		bool Ret, Recorded;
+		IdSet Reads;
+		GlobalContext::Delta Delta;
+		TimeSample Time;
+	};
+
+	IterativeModulePass *Pass;
+	ModuleList *Modules;
+	std::vector<unsigned> Work;
+	std::vector<Result> Results;
+
+	pthread_mutex_t Lock;
+	std::vector<Worker *> Workers, Idle;
+
+	Round(IterativeModulePass *P, ModuleList *M) : Pass(P), Modules(M) {
+		pthread_mutex_init(&Lock, NULL);
+	}
+	~Round() {
+		for (unsigned i = 0; i != Workers.size(); ++i)
+			delete Workers[i];
+		pthread_mutex_destroy(&Lock);
+	}
+};
+
+void IterativeModulePass::visitWorker(unsigned i, void *Arg) {
+	Round *R = (Round *)Arg;
+	pthread_mutex_lock(&R->Lock);
+	Worker *W;
+	if (R->Idle.empty()) {
+		W = new Worker(R->Pass);
+		R->Workers.push_back(W);
+	} else {
+		W = R->Idle.back();
+		R->Idle.pop_back();
+	}
+	pthread_mutex_unlock(&R->Lock);
+
+	Round::Result &Res = R->Results[i];
+	IterativeModulePass *P = W->Pass.get();
+	TimeSample T;
+	// other workers run at the same time, so only count this thread
+	if (Stats)
+		T = TimeSample::nowThread();
+	P->Changed.clear();
+	Res.Ret = P->doModulePass(R->Modules->get(R->Work[i]));
+	Res.Recorded = !P->Changed.empty();
+	Res.Reads.swap(P->Deps[0].Reads);
+	W->View.takeDelta(Res.Delta);
+	if (Stats)
+		Res.Time = TimeSample::nowThread() - T;
+
+	pthread_mutex_lock(&R->Lock);
+	R->Idle.push_back(W);
+	pthread_mutex_unlock(&R->Lock);
+}
+
+// Redo the local state of module m if it has been parsed again, or not
+// visited at all in an incremental run.  Global state is already at the
+// fixpoint and may have been finalized in other modules, so it is only
+// read.
+void IterativeModulePass::restoreModuleState(ModuleList &modules, unsigned m) {
+	if (!needsModuleState() || VisitedLoads[m] == modules.getLoads(m))
+		return;
+	CurModule = m;
+	Replaying = true;
+	doModulePass(modules.get(m));
+	Replaying = false;
+	VisitedLoads[m] = modules.getLoads(m);
+}
+
+bool IterativeModulePass::finalize(ModuleList &modules, unsigned m) {
+	restoreModuleState(modules, m);
+	return doFinalization(modules.get(m));
+}
+
+void IterativeModulePass::getFuncSCCs(Module *M, std::vector<FuncSCC> &SCCs) {
+	const CallOrder &CO = Ctx->getOrder();
+	Schedule S = CO.empty() ? InputOrder : getSchedule();
+	unsigned Last = CO.getNumSCCs();
+
+	// (position, index in M), sorted stably
+	std::vector<std::pair<unsigned, unsigned> > Keys;
+	std::vector<Function *> Funcs;
+	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
+		if (f->empty())
+			continue;
+		unsigned Pos = Funcs.size();
+		if (S != InputOrder) {
+			unsigned SCC = CO.getSCC(Ctx->FuncTab.get(&*f));
+			Pos = S == CalleesFirst ? SCC : Last - SCC;
+		}
+		Keys.push_back(std::make_pair(Pos, Funcs.size()));
+		Funcs.push_back(&*f);
+	}
+	std::sort(Keys.begin(), Keys.end());
+
+	SCCs.clear();
+	for (unsigned i = 0; i != Keys.size(); ++i) {
+		Function *F = Funcs[Keys[i].second];
+		if (i == 0 || Keys[i].first != Keys[i - 1].first) {
+			SCCs.push_back(FuncSCC());
+			SCCs.back().Recursive = S != InputOrder
+				&& CO.isRecursive(Ctx->FuncTab.get(F));
+		}
+		SCCs.back().Funcs.push_back(F);
+	}
+}
+
+void IterativeModulePass::run(ModuleList &modules, bool Finalize) {
+
+	unsigned n = modules.size();
+	Deps.assign(n, ModuleSummary());
+	Readers.clear();
+	Ctx->ModuleSums.resize(n);
+	if (Ctx->Stale.empty())
+		Ctx->Stale.assign(n, true);
+
+	VisitedLoads.assign(n, 0);
+
+	RunStats::PassStat *PS = Stats ? &Stats->addPass(ID) : NULL;
+	TimeSample Start, T;
+	if (PS)
+		Start = TimeSample::now();
 
-	ModuleList::iterator i, e;
 	Diag << "[" << ID << "] Initializing " << modules.size() << " modules ";
-	for (i = modules.begin(), e = modules.end(); i != e; ++i) {
-		doInitialization(i->first);
+	for (unsigned m = 0; m < n; ++m) {
+		doInitialization(modules.getGlobals(m));
 		Diag << ".";
 	}
 	Diag << "\n";
+	if (PS)
+		PS->Init = TimeSample::now() - Start;
+
+	// every stale module is visited in the first round; later rounds only
+	// revisit modules that read a global ID changed since their last visit
+	std::vector<bool> Dirty(Ctx->Stale);
+	for (unsigned m = 0; m < n; ++m) {
+		// up-to-date modules depend on what they read last time
+		if (!Dirty[m])
+			addReaders(m, Ctx->ModuleSums[m].Reads);
+	}
 
-	unsigned iter = 0, changed = 1;
-	while (changed) {
+	// Parallel batches need all their modules in memory.  Updates are
+	// merged in module order, so the result does not depend on threads.
+	OwningPtr<Round> Parallel;
+	if (ParallelPasses && !modules.isLimited()) {
+		OwningPtr<IterativeModulePass> Probe(clone(Ctx));
+		if (Probe.get())
+			Parallel.reset(new Round(this, &modules));
+	}
+	Round *R = Parallel.get();
+
+	// visit modules along the call graph, so that facts flowing through
+	// calls mostly arrive before their readers are visited
+	std::vector<unsigned> Order;
+	Schedule S = getSchedule();
+	if (S != InputOrder && !Ctx->getOrder().empty())
+		Ctx->getOrder().getModuleOrder(n, S == CallersFirst, Order);
+	else
+		for (unsigned m = 0; m < n; ++m)
+			Order.push_back(m);
+
+	unsigned iter = 0, changed;
+	while (std::find(Dirty.begin(), Dirty.end(), true) != Dirty.end()) {
 		++iter;
 		changed = 0;
-		for (i = modules.begin(), e = modules.end(); i != e; ++i) {
-			Diag << "[" << ID << " / " << iter << "] ";
-			Diag << "'" << i->first->getModuleIdentifier() << "'";
-
-			bool ret = doModulePass(i->first);
-			if (ret) {
-				++changed;
-				Diag << " [CHANGED]\n";
-			} else
-				Diag << "\n";
+		unsigned visited = 0;
+		RunStats::IterationStat *IS = NULL;
+		TimeSample IterStart;
+		if (PS) {
+			PS->Iterations.push_back(RunStats::IterationStat());
+			IS = &PS->Iterations.back();
+			IterStart = TimeSample::now();
+		}
+
+		for (unsigned Next = 0; Next < n; ) {
+			// visit one module, or a batch of modules in parallel
+			if (R) {
+				R->Work.clear();
+				for (; Next < n && R->Work.size() < ParallelBatch; ++Next) {
+					unsigned m = Order[Next];
+					if (Dirty[m]) {
+						Dirty[m] = false;
+						R->Work.push_back(m);
+						// read bodies here, workers only look modules up
+						modules.get(m);
+					}
+				}
+				R->Results.clear();
+				R->Results.resize(R->Work.size());
+				parallelFor(R->Work.size(), visitWorker, R);
+
+				// register all readers first, so that updates merged from
+				// one module reach every module that missed them
+				for (unsigned i = 0; i != R->Work.size(); ++i) {
+					unsigned m = R->Work[i];
+					Round::Result &Res = R->Results[i];
+					Deps[m].Reads.insert(Res.Reads.begin(), Res.Reads.end());
+					addReaders(m, Res.Reads);
+				}
+			} else if (!Dirty[Order[Next++]])
+				continue;
+
+			unsigned e = R ? R->Work.size() : 1;
+			for (unsigned i = 0; i < e; ++i) {
+				unsigned m = R ? R->Work[i] : Order[Next - 1];
+				Dirty[m] = false;
+				// later passes revisit modules visited here, since their
+				// callees, taints or ranges may have changed
+				Ctx->Stale[m] = true;
+				++visited;
+
+				Diag << "[" << ID << " / " << iter << "] ";
+				Diag << "'" << modules.getName(m) << "'";
+
+				bool ret, Recorded;
+				TimeSample Time;
+				Changed.clear();
+				if (R) {
+					Round::Result &Res = R->Results[i];
+					ret = Res.Ret;
+					Recorded = Res.Recorded;
+					Time = Res.Time;
+					Ctx->mergeDelta(Res.Delta, Changed);
+				} else {
+					if (IS)
+						T = TimeSample::now();
+					CurModule = m;
+					ret = doModulePass(modules.get(m));
+					Recorded = !Changed.empty();
+					if (IS)
+						Time = TimeSample::now() - T;
+					addReaders(m, Deps[m].Reads);
+				}
+				VisitedLoads[m] = modules.getLoads(m);
+				if (IS) {
+					RunStats::ModuleStat MS = { modules.getName(m), Time, ret };
+					IS->Modules.push_back(MS);
+				}
+
+				scheduleReaders(m, ret, Recorded, Dirty);
+
+				if (ret) {
+					++changed;
+					Diag << " [CHANGED]\n";
+				} else
+					Diag << "\n";
+			}
+
+			// modules not scheduled again have stable summaries for now,
+			// so their bodies are dropped right away
+			for (unsigned i = 0; i < e; ++i) {
+				unsigned m = R ? R->Work[i] : Order[Next - 1];
+				if (Dirty[m] || !modules.release(m))
+					continue;
+				// values cached by workers are gone
+				Module *M = modules.getGlobals(m);
+				for (unsigned w = 0; R && w != R->Workers.size(); ++w)
+					R->Workers[w]->View.Ids.forget(M);
+			}
+		}
+
+		Diag << "[" << ID << "] Visited " << visited << " modules, "
+		     << "updated in " << changed << " modules.\n";
+		if (IS) {
+			IS->Time = TimeSample::now() - IterStart;
+			IS->Visited = visited;
+			IS->Changed = changed;
 		}
-		Diag << "[" << ID << "] Updated in " << changed << " modules.\n";
+	}
+	Parallel.reset();
+	doFixpoint();
+
+	// accumulate dependencies over all passes
+	for (unsigned m = 0; m < n; ++m) {
+		ModuleSummary &S = Ctx->ModuleSums[m];
+		S.Reads.insert(Deps[m].Reads.begin(), Deps[m].Reads.end());
+		S.Writes.insert(Deps[m].Writes.begin(), Deps[m].Writes.end());
 	}
 
 	Diag << "\n[" << ID << "] Postprocessing ...\n";
-	for (i = modules.begin(), e = modules.end(); i != e; ++i) {
-		if (doFinalization(i->first) && !NoWriteback) {
-			Diag << "[" << ID << "] Writeback " << i->second << "\n";
-			doWriteback(i->first, i->second);
+	if (PS)
+		T = TimeSample::now();
+	// all modules stay in memory here, so restore local state before
+	// finalizing any of them
+	for (unsigned m = 0; Finalize && m < n; ++m)
+		restoreModuleState(modules, m);
+	for (unsigned m = 0; Finalize && m < n; ++m) {
+		if (finalize(modules, m) && !NoWriteback && !UseSidecar) {
+			Diag << "[" << ID << "] Writeback " << modules.getName(m) << "\n";
+			doWriteback(modules.get(m), modules.getName(m));
 		}
+		modules.release(m);
+	}
+	if (PS) {
+		TimeSample End = TimeSample::now();
+		PS->Final = End - T;
+		PS->Time = End - Start;
 	}
 			
 	Diag << "[" << ID << "] Done!\n";
 }
 
+// Shared state of a pool of worker threads
+struct ParallelState {
+	pthread_mutex_t Lock;
+	unsigned Next, Size;
+	void (*Fn)(unsigned, void *);
+	void *Arg;
+};
+
+static void *parallelWorker(void *Arg)
+{
+	ParallelState *S = (ParallelState *)Arg;
+	for (;;) {
+		pthread_mutex_lock(&S->Lock);
+		unsigned i = S->Next++;
+		pthread_mutex_unlock(&S->Lock);
+		if (i >= S->Size)
+			break;
+		S->Fn(i, S->Arg);
+	}
+	return NULL;
+}
+
+// Run Fn(i, Arg) for each i in [0, Size) on up to -j threads
+static void parallelFor(unsigned Size, void (*Fn)(unsigned, void *), void *Arg)
+{
+	unsigned n = NumThreads;
+	if (n == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		n = ncpu > 0 ? ncpu : 1;
+	}
+	if (n > Size)
+		n = Size;
+
+	ParallelState S;
+	pthread_mutex_init(&S.Lock, NULL);
+	S.Next = 0;
+	S.Size = Size;
+	S.Fn = Fn;
+	S.Arg = Arg;
+
+	if (n <= 1) {
+		parallelWorker(&S);
+	} else {
+		llvm_start_multithreaded();
+		std::vector<pthread_t> Threads(n);
+		for (unsigned i = 0; i < n; ++i)
+			if (pthread_create(&Threads[i], NULL, parallelWorker, &S))
+				report_fatal_error("cannot create worker thread");
+		for (unsigned i = 0; i < n; ++i)
+			pthread_join(Threads[i], NULL);
+	}
+	pthread_mutex_destroy(&S.Lock);
+}
+
+static void annotateModule(Module *M)
+{
+	for (Module::iterator j = M->begin(), je = M->end(); j != je; ++j)
+		annotateFunction(*j);
+}
+
+// Parse and annotate a module in its own LLVMContext, to avoid type
+// renaming.  Bitcode is loaded lazily (Lazy is set), leaving function
+// bodies and their annotation to materializeModule().  Err is empty if
+// the file is read but cannot be parsed.
+static Module *parseModule(StringRef Filename, uint64_t &Size,
+                           uint64_t *Hash, bool &Lazy, std::string &Err)
+{
+	OwningPtr<MemoryBuffer> Buffer;
+	if (error_code ec = MemoryBuffer::getFileOrSTDIN(Filename, Buffer)) {
+		Err = ec.message();
+		return NULL;
+	}
+	Size = Buffer->getBufferSize();
+	if (Hash)
+		*Hash = SummaryDB::hash(Buffer->getBuffer());
+
+	LLVMContext *LLVMCtx = new LLVMContext();
+	Module *M;
+	const unsigned char *Start =
+		(const unsigned char *)Buffer->getBufferStart();
+	Lazy = isBitcode(Start, Start + Size);
+	if (Lazy) {
+		// bodies are read from the buffer until the module is deleted;
+		// copy it, since the file may be mapped and written back
+		MemoryBuffer *Copy = MemoryBuffer::getMemBufferCopy(
+			Buffer->getBuffer(), Filename);
+		M = getLazyBitcodeModule(Copy, *LLVMCtx, &Err);
+	} else {
+		SMDiagnostic SMErr;
+		M = ParseIR(Buffer.take(), SMErr, *LLVMCtx);
+	}
+	if (M == NULL) {
+		delete LLVMCtx;
+		return NULL;
+	}
+
+	if (!Lazy)
+		annotateModule(M);
+	return M;
+}
+
+// Read all function bodies of a lazily loaded module and annotate them
+static bool materializeModule(Module *M, std::string &Err)
+{
+	if (M->MaterializeAll(&Err))
+		return false;
+	annotateModule(M);
+	return true;
+}
+
+// Drop all function bodies, which can be read again from the bitcode
+static void dematerializeModule(Module *M)
+{
+	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
+		if (!M->isDematerializable(&*f))
+			continue;
+		// deleting a body resets the linkage, which identifies functions
+		GlobalValue::LinkageTypes Linkage = f->getLinkage();
+		M->Dematerialize(&*f);
+		f->setLinkage(Linkage);
+	}
+}
+
+Module *ModuleList::get(unsigned i) {
+	Entry &E = Entries[i];
+	if (E.M && (!E.Lazy || E.Materialized)) {
+		if (Limit)
+			LRU.splice(LRU.end(), LRU, E.Pos);
+		return E.M;
+	}
+	makeRoom(i);
+	Module *M = E.M;
+	std::string Err;
+	if (E.Lazy) {
+		if (!materializeModule(M, Err))
+			report_fatal_error(Twine("cannot read '") + E.Name + "': " + Err);
+		Diag << "Materializing '" << E.Name << "'\n";
+	} else {
+		uint64_t Size;
+		bool Lazy;
+		M = parseModule(E.Name, Size, NULL, Lazy, Err);
+		if (!M)
+			report_fatal_error(Twine("cannot reload '") + E.Name + "': " + Err);
+		Diag << "Reloading '" << E.Name << "'\n";
+	}
+	loaded(i, M);
+	return M;
+}
+
+Module *ModuleList::getGlobals(unsigned i) {
+	Entry &E = Entries[i];
+	if (E.Lazy)
+		return E.M;
+	return get(i);
+}
+
+bool ModuleList::release(unsigned i) {
+	Entry &E = Entries[i];
+	if (!E.Lazy || !E.Materialized)
+		return false;
+	evict(i);
+	return true;
+}
+
+void ModuleList::add(StringRef Name, Module *M, uint64_t Size, bool Lazy) {
+	Entry E;
+	E.Name = Name;
+	E.M = NULL;
+	E.Size = Size;
+	E.Loads = 0;
+	E.Lazy = Lazy;
+	E.Materialized = false;
+	Entries.push_back(E);
+	unsigned i = Entries.size() - 1;
+	if (Lazy) {
+		// register functions now, bodies are read on first use
+		++NumLazy;
+		Entries[i].M = M;
+		for (unsigned j = 0; j != Observers.size(); ++j)
+			Observers[j]->moduleLoaded(i, M);
+		return;
+	}
+	makeRoom(i);
+	loaded(i, M);
+}
+
+void ModuleList::loaded(unsigned i, Module *M) {
+	Entry &E = Entries[i];
+	E.M = M;
+	E.Materialized = true;
+	E.Pos = LRU.insert(LRU.end(), i);
+	++E.Loads;
+	Resident += E.Size;
+	for (unsigned j = 0; j != Observers.size(); ++j)
+		Observers[j]->moduleLoaded(i, M);
+}
+
+// free module i, or only its function bodies if it is lazily loaded
+void ModuleList::evict(unsigned i) {
+	Entry &E = Entries[i];
+	for (unsigned j = 0; j != Observers.size(); ++j)
+		Observers[j]->moduleEvicted(i, E.M);
+	if (E.Lazy) {
+		dematerializeModule(E.M);
+	} else {
+		LLVMContext *LLVMCtx = &E.M->getContext();
+		delete E.M;
+		delete LLVMCtx;
+		E.M = NULL;
+	}
+	E.Materialized = false;
+	LRU.erase(E.Pos);
+	Resident -= E.Size;
+}
+
+void ModuleList::reserve(uint64_t Bytes) {
+	if (!Limit)
+		return;
+	while (!LRU.empty() && Resident + Bytes > Limit)
+		evict(LRU.front());
+}
+
+// evict least recently used modules to make room for module i
+void ModuleList::makeRoom(unsigned i) {
+	reserve(Entries[i].Size);
+}
+
+struct LoadState {
+	const char *ProgName;
+	// index of the first module of the batch being loaded
+	unsigned First;
+	std::vector<Module *> Loaded;
+	std::vector<uint64_t> Sizes;
+	std::vector<uint64_t> Hashes;
+	std::vector<bool> Lazy;
+};
+
+static Module *loadModule(unsigned i, LoadState *S)
+{
+	const std::string &Filename = InputFilenames[i];
+	std::string Err;
+	// sidecar files record the hash of the module they describe
+	bool NeedHash = !SummaryFile.empty() || UseSidecar;
+	uint64_t *Hash = NeedHash ? &S->Hashes[i] : NULL;
+	bool Lazy;
+	Module *M = parseModule(Filename, S->Sizes[i], Hash, Lazy, Err);
+	S->Lazy[i] = Lazy;
+
+	pthread_mutex_lock(&DiagLock);
+	if (M == NULL) {
+		errs() << S->ProgName << ": error loading file '" << Filename << "'";
+		if (!Err.empty())
+			errs() << ": " << Err;
+		errs() << "\n";
+	} else {
+		Diag << "Loading '" << Filename << "'\n";
+	}
+	pthread_mutex_unlock(&DiagLock);
+
+	// lazily loaded modules are annotated once their bodies are read
+	if (M && !Lazy && !NoWriteback && !UseSidecar)
+		doWriteback(M, Filename);
+	return M;
+}
+
+static void loadWorker(unsigned i, void *Arg)
+{
+	LoadState *S = (LoadState *)Arg;
+	// each thread fills its own slots, no lock needed
+	S->Loaded[S->First + i] = loadModule(S->First + i, S);
+}
+
+// Parse, annotate and write back modules in parallel; each module has
+// its own LLVMContext, so they are independent of each other.  With a
+// memory limit, modules are loaded in batches whose input files fit in
+// the limit, evicting earlier modules to make room for each batch.
+static void loadModules(const char *ProgName, uint64_t Limit)
+{
+	LoadState S;
+	unsigned n = InputFilenames.size();
+	S.ProgName = ProgName;
+	S.Loaded.resize(n, NULL);
+	S.Sizes.resize(n, 0);
+	S.Hashes.resize(n, 0);
+	S.Lazy.resize(n, false);
+
+	for (unsigned First = 0; First < n; ) {
+		unsigned Last = n;
+		uint64_t Bytes = 0;
+		if (Limit) {
+			for (Last = First; Last < n; ++Last) {
+				uint64_t Size;
+				if (sys::fs::file_size(InputFilenames[Last], Size))
+					Size = 0;
+				if (Last > First && Bytes + Size > Limit)
+					break;
+				Bytes += Size;
+			}
+			Modules.reserve(Bytes);
+		}
+		S.First = First;
+		parallelFor(Last - First, loadWorker, &S);
+
+		// keep the order of input files
+		for (unsigned i = First; i < Last; ++i) {
+			if (Module *M = S.Loaded[i]) {
+				Modules.add(InputFilenames[i], M, S.Sizes[i], S.Lazy[i]);
+				ModuleHashes.push_back(S.Hashes[i]);
+			}
+		}
+		First = Last;
+	}
+}
+
+static void writeFacts(unsigned i, void *Arg)
+{
+	std::string Path = getSidecarPath(Modules.getName(i)), Err;
+	if (!writeSidecar(Modules.get(i), ModuleHashes[i], Path, Err)) {
+		pthread_mutex_lock(&DiagLock);
+		errs() << (const char *)Arg << ": cannot write '" << Path
+		       << "': " << Err << "\n";
+		pthread_mutex_unlock(&DiagLock);
+	}
+}
+
+static void hashModule(unsigned i, void *Arg)
+{
+	uint64_t &H = ModuleHashes[i];
+	if (!SummaryDB::hashFile(Modules.getName(i), H)) {
+		// never matches, re-analyze next time
+		H = 0;
+	}
+}
+
 int main(int argc, char **argv)
 {
 	// Print a stack trace if we signal out.
@@ -105,50 +1242,88 @@ int main(int argc, char **argv)
 
 	llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
 	cl::ParseCommandLineOptions(argc, argv, "global analysis\n");
-	SMDiagnostic Err;	
-	
-	// Loading modules
-	Diag << "Total " << InputFilenames.size() << " file(s)\n";
 
-	for (unsigned i = 0; i < InputFilenames.size(); ++i) {
-		// use separate LLVMContext to avoid type renaming
-		LLVMContext *LLVMCtx = new LLVMContext();
-		Module *M = ParseIRFile(InputFilenames[i], Err, *LLVMCtx);
+	Modules.setLimit((uint64_t)MemLimit << 20);
+	Modules.addObserver(&GlobalCtx);
 
-		if (M == NULL) {
-			errs() << argv[0] << ": error loading file '" 
-				<< InputFilenames[i] << "'\n";
-			continue;
-		}
-
-		Diag << "Loading '" << InputFilenames[i] << "'\n";
+	OwningPtr<RunStats> StatsHolder;
+	if (!StatsFile.empty()) {
+		StatsHolder.reset(new RunStats());
+		Stats = StatsHolder.get();
+	}
 
-		// annotate
-		static AnnotationPass AnnoPass;
-		AnnoPass.doInitialization(*M);
-		for (Module::iterator j = M->begin(), je = M->end(); j != je; ++j)
-			AnnoPass.runOnFunction(*j);
-		if (!NoWriteback)
-			doWriteback(M, InputFilenames[i].c_str());
+	// Loading modules
+	Diag << "Total " << InputFilenames.size() << " file(s)\n";
+	loadModules(argv[0], (uint64_t)MemLimit << 20);
+	if (Stats)
+		Stats->endPhase("load", GlobalCtx);
 
-		Modules.push_back(std::make_pair(M, InputFilenames[i]));
+	// Seed global facts from the previous run
+	SummaryDB DB(&GlobalCtx);
+	if (!SummaryFile.empty() && DB.load(SummaryFile, Modules, ModuleHashes)) {
+		unsigned n = std::count(GlobalCtx.Stale.begin(),
+		                        GlobalCtx.Stale.end(), true);
+		Diag << "Loaded '" << SummaryFile << "', " << n << " of "
+		     << Modules.size() << " module(s) to analyze\n";
 	}
+	if (Stats && !SummaryFile.empty())
+		Stats->endPhase("summary-load", GlobalCtx);
 
 	// Main workflow
 	CallGraphPass CGPass(&GlobalCtx);
+	Modules.addObserver(&CGPass);
 	CGPass.run(Modules);
+	if (Stats)
+		Stats->endPhase("CallGraph", GlobalCtx);
 
+	// metadata of modules that are not kept in memory would be lost
+	// before output, so these are finalized by both passes at the end
+	bool Resident = Modules.isResident();
 	TaintPass TPass(&GlobalCtx);
-	TPass.run(Modules);
+	TPass.run(Modules, Resident);
+	if (Stats)
+		Stats->endPhase("Taint", GlobalCtx);
 
 	RangePass RPass(&GlobalCtx);
-	RPass.run(Modules);
+	RPass.run(Modules, Resident);
+	if (Stats)
+		Stats->endPhase("Range", GlobalCtx);
 
 	if (NoWriteback) {
 		TPass.dumpTaints();
 		RPass.dumpRange();
+	} else if (!Resident) {
+		// one module at a time
+		for (unsigned i = 0; i < Modules.size(); ++i) {
+			bool Changed = TPass.finalize(Modules, i);
+			Changed |= RPass.finalize(Modules, i);
+			if (UseSidecar)
+				writeFacts(i, argv[0]);
+			else if (Changed)
+				doWriteback(Modules.get(i), Modules.getName(i));
+			Modules.release(i);
+		}
+	} else if (UseSidecar) {
+		parallelFor(Modules.size(), writeFacts, argv[0]);
+	}
+
+	if (!SummaryFile.empty()) {
+		// modules have been rewritten; hash what the next run will read
+		if (!NoWriteback && !UseSidecar)
+			parallelFor(Modules.size(), hashModule, NULL);
+		std::string Err;
+		if (!DB.save(SummaryFile, Modules, ModuleHashes, Err))
+			errs() << argv[0] << ": cannot write '" << SummaryFile
+			       << "': " << Err << "\n";
+	}
+
+	if (Stats) {
+		Stats->endPhase("output", GlobalCtx);
+		std::string Err;
+		if (!Stats->write(StatsFile, Err))
+			errs() << argv[0] << ": cannot write '" << StatsFile
+			       << "': " << Err << "\n";
 	}
 
 	return 0;
 }
-
@@ -3,44 +3,379 @@
 #include <llvm/DebugInfo.h>
 #include <llvm/Module.h>
 #include <llvm/Instructions.h>
+#include <llvm/Analysis/Dominators.h>
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
 #include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SparseBitVector.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/StringExtras.h>
 #include <llvm/Support/ConstantRange.h>
+#include <llvm/Support/MathExtras.h>
 #include <llvm/Support/Path.h>
 #include <llvm/Support/raw_ostream.h>
+#include <deque>
+#include <list>
 #include <map>
 #include <set>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
+#include <pthread.h>
 
 #include "CRange.h"
+#include "PersistentMap.h"
 
-typedef std::vector< std::pair<llvm::Module *, llvm::StringRef> > ModuleList;
-typedef llvm::SmallPtrSet<llvm::Function *, 8> FuncSet;
-typedef std::map<llvm::StringRef, llvm::Function *> FuncMap;
-typedef std::map<std::string, FuncSet> FuncPtrMap;
+// Interned global ID (arg.*, ret.*, struct.*, var.*), 0 means no ID
+typedef unsigned GlobalID;
+
+// Map global ID strings to compact handles.  IDs of values and functions
+// are cached, so that the ID strings are built only once.  Interning is
+// thread-safe; a worker thread uses a table of its own that keeps its own
+// caches and interns IDs in the shared table.
+class IdTable {
+public:
+	explicit IdTable(IdTable *Shared_ = NULL);
+	~IdTable();
+
+	GlobalID get(llvm::StringRef Name);
+	llvm::StringRef getName(GlobalID Id) const;
+	// one past the largest ID
+	GlobalID bound() const;
+	// sort IDs by their names, for stable dumps
+	void sort(std::vector<GlobalID> &) const;
+
+	GlobalID getValueId(llvm::Value *V);
+	GlobalID getArgId(llvm::Argument *A);
+	GlobalID getArgId(llvm::Function *F, unsigned no);
+	GlobalID getRetId(llvm::Function *F);
+	GlobalID getRetId(llvm::CallInst *CI);
+
+	// drop cached IDs of values of M, which is being evicted
+	void forget(llvm::Module *M);
+
+private:
+	IdTable *Shared;
+	mutable pthread_mutex_t Lock;
+	llvm::StringMap<GlobalID> Map;
+	std::vector<llvm::StringRef> Names;
+
+	// cached IDs of the values of one module
+	struct ModuleCache {
+		llvm::DenseMap<llvm::Value *, GlobalID> ValueIds;
+		llvm::DenseMap<llvm::Function *, GlobalID> RetIds;
+		llvm::DenseMap<std::pair<llvm::Function *, unsigned>, GlobalID> ArgIds;
+	};
+	std::map<llvm::Module *, ModuleCache> Caches;
+};
+
+// Dense storage of global facts indexed by GlobalID.  A map may read
+// through to a base map, which it never modifies: entries of the base are
+// copied on first write, so that the map holds the updates only.
+template <typename T>
+class IdMap {
+public:
+	explicit IdMap(const T &E = T()) : Base(NULL), Empty(E), NumDefined(0) { }
+
+	void setBase(const IdMap *B) { Base = B; }
+
+	const T *find(GlobalID Id) const {
+		if (Id < Defined.size() && Defined[Id])
+			return &Values[Id];
+		return Base ? Base->find(Id) : NULL;
+	}
+	bool count(GlobalID Id) const { return find(Id) != NULL; }
+
+	// create an entry if not defined yet, empty or copied from the base
+	T &operator[](GlobalID Id) {
+		if (Id >= Defined.size()) {
+			Values.resize(Id + 1, Empty);
+			Defined.resize(Id + 1, false);
+		}
+		if (!Defined[Id]) {
+			Defined[Id] = true;
+			++NumDefined;
+			if (const T *B = Base ? Base->find(Id) : NULL)
+				Values[Id] = *B;
+		}
+		return Values[Id];
+	}
+	// insert if not defined yet; return true if inserted
+	bool insert(GlobalID Id, const T &V) {
+		if (count(Id))
+			return false;
+		(*this)[Id] = V;
+		return true;
+	}
+
+	// one past the largest ID defined in this map, not in the base
+	GlobalID bound() const { return Defined.size(); }
+	unsigned size() const { return NumDefined; }
+	void clear() {
+		Values.clear();
+		Defined.clear();
+		NumDefined = 0;
+	}
+	// exchange entries, keeping the bases
+	void swap(IdMap &RHS) {
+		Values.swap(RHS.Values);
+		Defined.swap(RHS.Defined);
+		std::swap(NumDefined, RHS.NumDefined);
+	}
+
+private:
+	const IdMap *Base;
+	std::vector<T> Values;
+	std::vector<bool> Defined;
+	T Empty;
+	unsigned NumDefined;
+};
+
+// Index of a function in FuncTable, 0 means no function
+typedef unsigned FuncID;
+
+// Whether F is defined, including functions whose bodies are not read
+// from lazily loaded bitcode yet, which isDeclaration() reports as
+// declarations.
+static inline bool hasBody(const llvm::Function *F) {
+	return !F->isDeclaration() || F->isMaterializable();
+}
+
+// Functions of all modules.  Unlike llvm::Function, entries stay valid
+// when their module is evicted from memory.
+struct FuncInfo {
+	llvm::StringRef Name;
+	// scope name, see getScopeName()
+	std::string Scope;
+	// index of the module in the module list
+	unsigned Module;
+	bool isDeclaration;
+	bool isVarArg;
+	bool hasInternalLinkage;
+	// cached global IDs
+	GlobalID RetId;
+	std::vector<GlobalID> ArgIds;
+};
+
+// Lookups are thread-safe; a table created with a Shared table forwards
+// all calls to it, for use in worker threads.  Modules are registered
+// and removed by the main thread only.
+class FuncTable {
+public:
+	explicit FuncTable(IdTable *Ids_, FuncTable *Shared_ = NULL);
+	~FuncTable();
+
+	// register functions of a (re)loaded module
+	void addModule(unsigned Index, llvm::Module *M);
+	// forget functions of a module to be evicted
+	void removeModule(llvm::Module *M);
+
+	FuncID get(llvm::Function *F);
+	FuncID get(unsigned Module, llvm::StringRef Name) const;
+	const FuncInfo &operator[](FuncID Id) const;
+
+	GlobalID getArgId(FuncID Id, unsigned no);
+	GlobalID getRetId(FuncID Id);
+
+	// global function definitions by name
+	void setDefinition(llvm::StringRef Name, FuncID Id);
+	FuncID getDefinition(llvm::StringRef Name) const;
+
+private:
+	IdTable *Ids;
+	FuncTable *Shared;
+	mutable pthread_mutex_t Lock;
+	// keyed by module index and function name
+	llvm::StringMap<FuncID> Map;
+	llvm::StringMap<FuncID> Defs;
+	// entries stay in place while others are added
+	std::deque<FuncInfo> Infos;
+	llvm::DenseMap<llvm::Module *, unsigned> ModuleIndex;
+	llvm::DenseMap<llvm::Function *, FuncID> Cache;
+
+	FuncID add(unsigned Index, llvm::Function *F);
+};
+
+// Notified when modules are loaded into or evicted from memory.  A lazily
+// loaded module is first announced without function bodies, and again
+// each time its bodies are read.
+class ModuleObserver {
+public:
+	virtual ~ModuleObserver() { }
+	virtual void moduleLoaded(unsigned Index, llvm::Module *M) { }
+	virtual void moduleEvicted(unsigned Index, llvm::Module *M) { }
+};
+
+// Input modules.  With a memory limit, the least recently used modules
+// are evicted and parsed again on demand, so that only summaries in the
+// global context stay resident.  Bitcode modules are loaded lazily: their
+// function bodies are read on first use, and only the bodies are dropped
+// when such a module is evicted or released.
+class ModuleList {
+public:
+	ModuleList() : Limit(0), Resident(0), NumLazy(0) { }
+
+	unsigned size() const { return Entries.size(); }
+	bool empty() const { return Entries.empty(); }
+	llvm::StringRef getName(unsigned i) const { return Entries[i].Name; }
+
+	// Return module i, parsing it again if it has been evicted.  This may
+	// evict other modules, so only the returned module stays valid until
+	// the next call.
+	llvm::Module *get(unsigned i);
+	// Return module i with its globals and function declarations, without
+	// reading function bodies of a lazily loaded module
+	llvm::Module *getGlobals(unsigned i);
+	// drop function bodies of module i if it is lazily loaded; they are
+	// read again on the next get().  Return true if dropped.
+	bool release(unsigned i);
+	// number of times module i has been parsed
+	unsigned getLoads(unsigned i) const { return Entries[i].Loads; }
+
+	// append a parsed module; Size is the size of its input file
+	void add(llvm::StringRef Name, llvm::Module *M, uint64_t Size,
+	         bool Lazy = false);
+	void addObserver(ModuleObserver *O) { Observers.push_back(O); }
+
+	// keep resident modules within Bytes of input size, 0 means no limit
+	void setLimit(uint64_t Bytes) { Limit = Bytes; }
+	// evict modules until Bytes more fit within the limit
+	void reserve(uint64_t Bytes);
+	bool isLimited() const { return Limit != 0; }
+	// whether all modules stay in memory with their bodies, so that
+	// changes to them are never lost
+	bool isResident() const { return !Limit && !NumLazy; }
+
+private:
+	struct Entry {
+		llvm::StringRef Name;
+		llvm::Module *M;
+		uint64_t Size;
+		unsigned Loads;
+		// read from bitcode on demand, and whether bodies are read
+		bool Lazy, Materialized;
+		// position in LRU if resident
+		std::list<unsigned>::iterator Pos;
+	};
+	std::vector<Entry> Entries;
+	std::vector<ModuleObserver *> Observers;
+	// resident modules, least recently used first
+	std::list<unsigned> LRU;
+	uint64_t Limit, Resident;
+	unsigned NumLazy;
+
+	void loaded(unsigned i, llvm::Module *M);
+	void evict(unsigned i);
+	void makeRoom(unsigned i);
+};
+
+// FuncIDs are dense, so sets of functions are sparse bitvectors; unions
+// and comparisons work a word at a time, and iteration is in ID order
+typedef llvm::SparseBitVector<> FuncSet;
+typedef IdMap<FuncSet> FuncPtrMap;
 typedef llvm::DenseMap<llvm::CallInst *, FuncSet> CalleeMap;
-typedef std::set<llvm::StringRef> DescSet;
-typedef std::map<std::string, CRange> RangeMap;
+
+// A set of taint descriptions, by their index in TaintMap.  There are
+// few descriptions, so the first 64 are bits of a word and the rest
+// spill into a sorted vector.
+class DescSet {
+public:
+	DescSet() : Bits(0) { }
+
+	bool empty() const { return !Bits && Spill.empty(); }
+	unsigned size() const
+		{ return llvm::CountPopulation_64(Bits) + Spill.size(); }
+	// return true if the set grew
+	bool insert(unsigned D);
+	bool insert(const DescSet &RHS);
+	// indices in ascending order
+	void getIndices(std::vector<unsigned> &V) const;
+
+	bool operator==(const DescSet &RHS) const
+		{ return Bits == RHS.Bits && Spill == RHS.Spill; }
+	bool operator!=(const DescSet &RHS) const
+		{ return !(*this == RHS); }
+	bool operator<(const DescSet &RHS) const {
+		if (Bits != RHS.Bits)
+			return Bits < RHS.Bits;
+		return Spill < RHS.Spill;
+	}
+
+private:
+	enum { NumBits = 64 };
+	uint64_t Bits;
+	std::vector<unsigned> Spill;
+};
+typedef IdMap<CRange> RangeMap;
+
+// The call graph over functions of all modules, condensed into strongly
+// connected components.  Components are numbered callees first.
+class CallOrder {
+public:
+	CallOrder() : NumSCCs(0) { }
+
+	// record potential callees of calls in F, defined in module m
+	void addCalls(FuncID F, unsigned m, const FuncSet &Callees);
+	// number the components; done once all modules are recorded
+	void compute();
+	bool empty() const { return SCCs.empty(); }
+
+	// component of F, smaller than those of its callers
+	unsigned getSCC(FuncID F) const
+		{ return F < SCCs.size() ? SCCs[F] : 0; }
+	unsigned getNumSCCs() const { return NumSCCs; }
+	// whether F may call itself, directly or not
+	bool isRecursive(FuncID F) const
+		{ return F < Recursive.size() && Recursive[F]; }
+
+	// indices of n modules, ordered by the first of their components in
+	// callees-first or callers-first order
+	void getModuleOrder(unsigned n, bool CallersFirst,
+	                    std::vector<unsigned> &Order) const;
+
+private:
+	// indexed by function ID
+	std::vector<FuncSet> Succs;
+	std::vector<int> Modules;
+	std::vector<unsigned> SCCs;
+	std::vector<bool> Recursive;
+	unsigned NumSCCs;
+};
 
 
 class TaintMap {
 
 public:
-	typedef std::map<std::string, std::pair<DescSet, bool> > GlobalMap;
+	typedef IdMap<std::pair<DescSet, bool> > GlobalMap;
 	typedef std::map<llvm::Value *, DescSet> ValueMap;
 	
 	GlobalMap GTS;
 	ValueMap VTS;
 
-	void add(llvm::Value *V, const DescSet &D) {
-		VTS[V].insert(D.begin(), D.end());
+	TaintMap();
+	~TaintMap();
+
+	// Index of a description, copied out of module metadata, which may
+	// be evicted.  Views share the descriptions of their base.
+	unsigned intern(llvm::StringRef D);
+	llvm::StringRef getDesc(unsigned Index) const;
+	void shareDescs(TaintMap *Base) { Shared = Base; }
+	// descriptions joined by ", " in lexical order
+	std::string toString(const DescSet &D) const;
+
+	// drop local taints of a module to be evicted
+	void forget(llvm::Module *M);
+	// move all local taints to Out, which must be empty
+	void takeValues(ValueMap &Out);
+
+	// return true if the taint of V grew
+	bool add(llvm::Value *V, const DescSet &D) {
+		return getEntry(V).insert(D);
 	}
-	void add(llvm::Value *V, llvm::StringRef D) {
-		VTS[V].insert(D);
+	bool add(llvm::Value *V, unsigned D) {
+		return getEntry(V).insert(D);
 	}
 	DescSet* get(llvm::Value *V) {
 		ValueMap::iterator it = VTS.find(V);
@@ -49,36 +384,84 @@ public:
 		return NULL;
 	}
 
-	DescSet* get(const std::string &ID) {
-		if (ID.empty())
-			return NULL;
-		GlobalMap::iterator it = GTS.find(ID);
-		if (it != GTS.end())
-			return &it->second.first;
+	const DescSet* get(GlobalID ID) const {
+		if (const std::pair<DescSet, bool> *entry = GTS.find(ID))
+			return &entry->first;
 		return NULL;
 	}
-	bool add(const std::string &ID, const DescSet &D, bool isSource = false) {
-		if (ID.empty())
+	// return true if the taint of ID grew
+	bool add(GlobalID ID, const DescSet &D, bool isSource = false) {
+		if (!ID)
 			return false;
 		std::pair<DescSet, bool> &entry = GTS[ID];
-		bool isNew = entry.first.empty();
-		entry.first.insert(D.begin(), D.end());
+		bool wasSource = entry.second;
 		entry.second |= isSource;
-		return isNew;
+		return entry.first.insert(D) || entry.second != wasSource;
 	}
-	bool isSource(const std::string &ID) {
-		if (ID.empty())
-			return false;
-		GlobalMap::iterator it = GTS.find(ID);
-		if (it == GTS.end())
-			return false;
-		return it->second.second;
+	// Whether ID is a taint source, for passes consulting taint facts.
+	// A lookup by ID, which reads through to the base of a view.
+	bool isSource(GlobalID ID) const {
+		if (const std::pair<DescSet, bool> *entry = GTS.find(ID))
+			return entry->second;
+		return false;
 	}
+
+private:
+	TaintMap *Shared;
+	// values in VTS by module, so that eviction does not scan VTS
+	std::map<llvm::Module *, std::vector<llvm::Value *> > ModuleValues;
+
+	DescSet &getEntry(llvm::Value *V);
+	mutable pthread_mutex_t Lock;
+	llvm::StringMap<unsigned> DescIndex;
+	std::vector<llvm::StringRef> Descs;
+};
+
+typedef std::set<GlobalID> IdSet;
+
+// Global IDs a module reads and writes during the iterative passes
+struct ModuleSummary {
+	IdSet Reads;
+	IdSet Writes;
 };
 
-struct GlobalContext {
-	// Map global function name to function definition
-	FuncMap Funcs;
+struct GlobalContext : public ModuleObserver {
+	GlobalContext()
+		: Base(NULL), FuncTab(&Ids), IntRanges(CRange(1, false)),
+		  RawRanges(CRange(1, false)) { }
+	// A view of Base for a worker thread.  IDs, functions and callees are
+	// shared; facts are read from Base, but updated in the view only.
+	explicit GlobalContext(GlobalContext *Base_);
+
+	// Keep functions registered and drop state of evicted modules
+	virtual void moduleLoaded(unsigned Index, llvm::Module *M);
+	virtual void moduleEvicted(unsigned Index, llvm::Module *M);
+
+	// Facts updated in a view
+	struct Delta {
+		FuncPtrMap FuncPtrs;
+		TaintMap::GlobalMap GTS;
+		TaintMap::ValueMap VTS;
+		RangeMap IntRanges;
+		RangeMap RawRanges;
+		Delta() : IntRanges(CRange(1, false)), RawRanges(CRange(1, false)) { }
+	};
+	// move the updates of a view to D, leaving the view unchanged from Base
+	void takeDelta(Delta &D);
+	// join D into the facts and collect IDs whose facts changed
+	void mergeDelta(Delta &D, IdSet &Changed);
+
+	// potential callees of a callsite, NULL if unknown
+	const FuncSet *getCallees(llvm::CallInst *CI) const;
+
+	// NULL unless this is a view
+	GlobalContext *Base;
+
+	// Interned global IDs
+	IdTable Ids;
+
+	// Functions of all modules
+	FuncTable FuncTab;
 
 	// Map function pointers (IDs) to possible assignments
 	FuncPtrMap FuncPtrs;
@@ -86,22 +469,84 @@ struct GlobalContext {
 	// Map a callsite to all potential callees
 	CalleeMap Callees;
 
+	// Components of the call graph, shared with views
+	CallOrder Order;
+	const CallOrder &getOrder() const { return Base ? Base->Order : Order; }
+
 	// Taints
 	TaintMap Taints;
 
 	// Ranges
 	RangeMap IntRanges;
+	// Ranges before widening, kept by RangePass for narrowing
+	RangeMap RawRanges;
+
+	// Summaries of modules, indexed like the module list
+	std::vector<ModuleSummary> ModuleSums;
+
+	// Modules to (re)analyze, indexed like the module list; empty means
+	// all modules.  Seeded from a summary database for incremental runs.
+	std::vector<bool> Stale;
 };
 
 class IterativeModulePass {
 protected:
 	GlobalContext *Ctx;
 	const char * ID;
+
+	// Dependencies of the module being processed, used to revisit only
+	// modules whose inputs changed in later rounds
+	void addRead(GlobalID Id);
+	void addWrite(GlobalID Id);
+	// whether the module pass only restores the local state of a module
+	// after the fixpoint; it must not change global state then
+	bool isReplaying() const { return Replaying; }
+	// index of the module being processed
+	unsigned getCurrentModule() const { return CurModule; }
+
+	// order in which modules and functions are visited
+	enum Schedule { InputOrder, CalleesFirst, CallersFirst };
+	virtual Schedule getSchedule()
+		{ return InputOrder; }
+
+	// functions of a component of the call graph within one module
+	struct FuncSCC {
+		std::vector<llvm::Function *> Funcs;
+		bool Recursive;
+	};
+	// functions of M with bodies, grouped by component in the order of
+	// getSchedule().  A component spanning several modules is split into
+	// its part in each module; facts flow between the parts only through
+	// later rounds, not by iterating in place.
+	void getFuncSCCs(llvm::Module *M, std::vector<FuncSCC> &SCCs);
+
+private:
+	typedef std::set<unsigned> ModuleSet;
+
+	// Map a global ID to indices of modules that read it
+	std::vector<ModuleSet> Readers;
+	std::vector<ModuleSummary> Deps;
+	// IDs changed by the current module pass
+	IdSet Changed;
+	unsigned CurModule;
+	bool Replaying;
+	// load count of each module at its last visit
+	std::vector<unsigned> VisitedLoads;
+
+	struct Worker;
+	struct Round;
+	static void visitWorker(unsigned i, void *Arg);
+	void addReaders(unsigned m, const IdSet &Reads);
+	void scheduleReaders(unsigned m, bool ret, bool Recorded,
+	                     std::vector<bool> &Dirty);
+	void restoreModuleState(ModuleList &modules, unsigned m);
+
 public:
 	IterativeModulePass(GlobalContext *Ctx_, const char *ID_)
-		: Ctx(Ctx_), ID(ID_) { }
+		: Ctx(Ctx_), ID(ID_), CurModule(0), Replaying(false) { }
 	
-	// run on each module before iterative pass
+	// run on each module before iterative pass; function bodies of M
+	// may not be loaded
 	virtual bool doInitialization(llvm::Module *M)
 		{ return true; }
 
@@ -113,26 +558,111 @@ public:
 	virtual bool doModulePass(llvm::Module *M)
 		{ return false; }
 
-	virtual void run(ModuleList &modules);
+	// run once the module passes are stable, before doFinalization
+	virtual void doFixpoint() { }
+
+	// a pass of the same kind on a view of the global context, to visit
+	// modules in a worker thread; NULL if the pass cannot run in parallel
+	virtual IterativeModulePass *clone(GlobalContext *View)
+		{ return NULL; }
+
+	// whether module m is known to gain nothing from another visit,
+	// so that changes to IDs it reads do not schedule it again
+	virtual bool isSettled(unsigned m)
+		{ return false; }
+
+	// whether doFinalization needs the state left by doModulePass on
+	// the same module, which is lost if the module is parsed again
+	virtual bool needsModuleState()
+		{ return false; }
+
+	// Without Finalize, the caller finalizes each module after the pass
+	virtual void run(ModuleList &modules, bool Finalize = true);
+	// finalize module m, redoing its module pass if its local state has
+	// been lost; return true if the module needs to be written back
+	bool finalize(ModuleList &modules, unsigned m);
 };
 
-class CallGraphPass : public IterativeModulePass {
+// Function pointer assignments are solved as inclusion constraints over
+// global IDs.  Each module is scanned once for its constraints; an edge
+// Src -> Dst means FuncPtrs[Dst] includes FuncPtrs[Src].  IDs on a cycle
+// are collapsed into one node, and only functions new to a node are
+// pushed along its edges.  The solver is global, so this pass does not
+// run in parallel.
+class CallGraphPass : public IterativeModulePass, public ModuleObserver {
 private:
-	bool runOnFunction(llvm::Function *);
+	// functions a value may hold, directly or through IDs
+	struct Operand {
+		FuncSet Funcs;
+		std::vector<GlobalID> Srcs;
+		bool empty() const { return Funcs.empty() && Srcs.empty(); }
+	};
+	// a call passing function pointers to callees known through IDs
+	struct CallCons {
+		std::vector<std::pair<unsigned, Operand> > Args;
+		// callees whose arguments have been connected
+		FuncSet Resolved;
+	};
+	struct Node {
+		// union-find parent, 0 for a representative
+		GlobalID Rep;
+		// IDs merged into this representative
+		std::vector<GlobalID> Merged;
+		IdSet Succs;
+		// functions not yet pushed along edges and calls
+		FuncSet Pending;
+		// calls whose callee may come through this node
+		std::vector<unsigned> Calls;
+		Node() : Rep(0) { }
+	};
+
+	bool Finalized;
+	// whether the current module pass grew any function pointer set
+	bool Updated;
+	// indexed by global ID; a deque keeps references across growth
+	std::deque<Node> Nodes;
+	std::vector<CallCons> Calls;
+	// nodes with pending functions
+	std::vector<GlobalID> Worklist;
+	// edges already checked for cycles
+	llvm::DenseSet<std::pair<GlobalID, GlobalID> > Checked;
+	// modules whose constraints are in the graph, by index
+	std::vector<bool> Extracted;
+
+	void addCallees(llvm::Module *);
+	void extract(llvm::Function *);
 	void processInitializers(llvm::Module *, llvm::Constant *, llvm::GlobalValue *);
-	bool mergeFuncSet(FuncSet &S, const std::string &Id);
+	bool mergeFuncSet(FuncSet &S, GlobalID Id);
 	bool mergeFuncSet(FuncSet &Dst, const FuncSet &Src);
 	bool findFunctions(llvm::Value *, FuncSet &);
-	bool findFunctions(llvm::Value *, FuncSet &, 
-	                   llvm::SmallPtrSet<llvm::Value *, 4>);
-
+	void collect(llvm::Value *, Operand &, llvm::SmallPtrSet<llvm::Value *, 4> &);
+
+	// constraint graph
+	GlobalID find(GlobalID Id);
+	bool addFuncs(GlobalID Rep, const FuncSet &S);
+	void addEdge(GlobalID Src, GlobalID Dst);
+	void addAssign(GlobalID Dst, const Operand &Op);
+	void addCall(const Operand &Callee, unsigned c);
+	void resolve(unsigned c, const FuncSet &S);
+	void connect(unsigned c, FuncID Callee);
+	void collapseCycles(GlobalID Start);
+	void unite(GlobalID From, GlobalID To);
+	void solve();
 
 public:
 	CallGraphPass(GlobalContext *Ctx_)
-		: IterativeModulePass(Ctx_, "CallGraph") { }
+		: IterativeModulePass(Ctx_, "CallGraph"), Finalized(false),
+		  Updated(false) { }
 	virtual bool doInitialization(llvm::Module *);
 	virtual bool doFinalization(llvm::Module *);
 	virtual bool doModulePass(llvm::Module *);
+	virtual bool isSettled(unsigned m)
+		{ return m < Extracted.size() && Extracted[m]; }
+	// also numbers the components of the call graph
+	virtual void run(ModuleList &modules, bool Finalize = true);
+
+	// rebuild callees of modules parsed again after finalization
+	virtual void moduleLoaded(unsigned Index, llvm::Module *M);
 
 	// debug
 	void dumpFuncPtrs();
@@ -142,9 +672,9 @@ public:
 class TaintPass : public IterativeModulePass {
 private:
 	DescSet* getTaint(llvm::Value *);
-	bool runOnFunction(llvm::Function *);
+	const DescSet* getTaint(GlobalID Id);
+	bool addTaint(GlobalID Id, const DescSet &D, bool isSource = false);
 	bool checkTaintSource(llvm::Value *);
-	bool markTaint(const std::string &Id, bool isSource);
 
 	bool checkTaintSource(llvm::Instruction *I);
 	bool checkTaintSource(llvm::Function *F);
@@ -152,12 +682,32 @@ private:
 	typedef llvm::DenseMap<llvm::Value *, DescSet> ValueTaintSet;
 	ValueTaintSet VTS;
 
+	// Sparse propagation within a module: values whose taint grew are
+	// queued, and global IDs map to the values of the module reading them
+	std::vector<llvm::Value *> Worklist;
+	llvm::SmallPtrSet<llvm::Value *, 32> Queued;
+	llvm::DenseMap<GlobalID, std::vector<llvm::Value *> > LocalReaders;
+	// whether the current module pass grew any global taint
+	bool Grew;
+
+	std::map<DescSet, std::string> DescStrings;
+	llvm::StringRef getDescString(const DescSet &D);
+
+	void push(llvm::Value *V);
+	void addReader(GlobalID Id, llvm::Value *V);
+	void propagate(llvm::Value *V);
+	void propagate(llvm::CallInst *CI, llvm::Value *Arg);
+
 public:
 	TaintPass(GlobalContext *Ctx_)
-		: IterativeModulePass(Ctx_, "Taint") { }
+		: IterativeModulePass(Ctx_, "Taint"), Grew(false) { }
 	virtual bool doModulePass(llvm::Module *);
 	virtual bool doFinalization(llvm::Module *);
-	bool isTaintSource(const std::string &sID);
+	virtual bool needsModuleState() { return true; }
+	virtual IterativeModulePass *clone(GlobalContext *View)
+		{ return new TaintPass(View); }
+	// taint sources are mostly arguments of entry points
+	virtual Schedule getSchedule() { return CallersFirst; }
 
 	// debug
 	void dumpTaints();
@@ -170,21 +720,53 @@ private:
 	const unsigned MaxIterations;	
 	
 	bool safeUnion(CRange &CR, const CRange &R);
-	bool unionRange(llvm::StringRef, const CRange &, llvm::Value *);
+	bool unionRange(GlobalID, const CRange &, llvm::Value *);
 	bool unionRange(llvm::BasicBlock *, llvm::Value *, const CRange &);
 	CRange getRange(llvm::BasicBlock *, llvm::Value *);
 
 	void collectInitializers(llvm::GlobalVariable *, llvm::Constant *);
+	bool updateRangeFor(const FuncSCC &);
 	bool updateRangeFor(llvm::Function *);
 	bool updateRangeFor(llvm::BasicBlock *);
 	bool updateRangeFor(llvm::Instruction *);
 
-	typedef std::map<llvm::Value *, CRange> ValueRangeMap;
+	// per-block ranges, shared with predecessors until refined
+	typedef PersistentMap<llvm::Value *, CRange> ValueRangeMap;
 	typedef std::map<llvm::BasicBlock *, ValueRangeMap> FuncValueRangeMaps;
 	FuncValueRangeMaps FuncVRMs;
 
-	typedef std::set<std::string> ChangeSet;
+	// The sparse engine names each value once, plus once per block
+	// entered through a branch or switch that refines it; such a name
+	// is valid in the blocks the block dominates.  Names are evaluated
+	// along def-use edges, visiting blocks in reverse post-order.
+	typedef std::pair<llvm::BasicBlock *, llvm::Value *> Name;
+	llvm::DenseMap<Name, unsigned> NameIndex;
+	std::vector<CRange> NameRanges;
+	llvm::SmallPtrSet<llvm::Value *, 16> Refined;
+	// dominators of the function being analyzed, NULL for the dense engine
+	llvm::DominatorTreeBase<llvm::BasicBlock> *DT;
+
+	const CRange *findName(llvm::BasicBlock *, llvm::Value *);
+	bool unionName(llvm::BasicBlock *, llvm::Value *, const CRange &);
+	const CRange *lookupName(llvm::BasicBlock *, llvm::Value *);
+	bool updateSparseRangeFor(llvm::Function *);
+
+	// ranges of values refined on entry to a block
+	typedef llvm::SmallVector<std::pair<llvm::Value *, CRange>, 2> RangeList;
+
+	typedef std::set<GlobalID> ChangeSet;
 	ChangeSet Changes;
+	// IDs changed in the previous iteration, widened if they grow again
+	ChangeSet Unstable;
+	// (ID, module) pairs whose range grew in a visit of the module.  If
+	// the module grows the range again in a later round, facts cycle
+	// through other modules, so the range is widened as well.
+	std::set<std::pair<GlobalID, unsigned> > Grown;
+
+	// constants the module compares against, and their neighbors
+	std::vector<int64_t> Thresholds;
+	void collectThresholds(llvm::Module *);
+	CRange widen(const CRange &Old, const CRange &New);
 	
 	typedef std::pair<const llvm::BasicBlock *, const llvm::BasicBlock *> Edge;
 	typedef llvm::SmallVector<Edge, 16> EdgeList;
@@ -202,19 +784,25 @@ private:
 	bool visitStoreInst(llvm::StoreInst *);
 
 	void visitBranchInst(llvm::BranchInst *, 
-						 llvm::BasicBlock *, ValueRangeMap &);
+						 llvm::BasicBlock *, RangeList &);
 	void visitTerminator(llvm::TerminatorInst *,
-						 llvm::BasicBlock *, ValueRangeMap &);
+						 llvm::BasicBlock *, RangeList &);
 	void visitSwitchInst(llvm::SwitchInst *, 
-						 llvm::BasicBlock *, ValueRangeMap &);
+						 llvm::BasicBlock *, RangeList &);
 
 public:
 	RangePass(GlobalContext *Ctx_)
-		: IterativeModulePass(Ctx_, "Range"), MaxIterations(5) { }
+		: IterativeModulePass(Ctx_, "Range"), MaxIterations(5), DT(NULL) { }
 	
 	virtual bool doInitialization(llvm::Module *);
 	virtual bool doModulePass(llvm::Module *M);
+	virtual void doFixpoint();
 	virtual bool doFinalization(llvm::Module *);
+	// no clone(): whether a range is widened depends on the order in
+	// which modules grow it, so modules are always visited one by one
+
+	// ranges returned by callees are used before arguments are passed
+	virtual Schedule getSchedule() { return CalleesFirst; }
 
 	// debug
 	void dumpRange();
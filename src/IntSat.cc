@@ -9,6 +9,7 @@
 #define DEBUG_TYPE "int-sat"
 #include "Diagnostic.h"
 #include "PathGen.h"
+#include "RangeGen.h"
 #include "SMTSolver.h"
 #include "ValueGen.h"
 #include <llvm/BasicBlock.h>
@@ -22,6 +23,7 @@
 #include <llvm/ADT/OwningPtr.h>
 #include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/InstIterator.h>
 #include <llvm/Support/raw_ostream.h>
@@ -29,6 +31,8 @@
 
 using namespace llvm;
 
+STATISTIC(NumDischarged, "Number of checks ruled out by operand ranges");
+
 static cl::opt<bool>
 SMTModelOpt("smt-model", cl::desc("Output SMT model"));
 
@@ -51,15 +55,24 @@ private:
 	Diagnostic Diag;
 	Function *Trap;
 	OwningPtr<DataLayout> TD;
+	OwningPtr<RangeGen> RG;
 	unsigned MD_bug;
 
+	// One solver session per function; path guards and operands are
+	// built once and each check is posed as an assumption.
+	OwningPtr<SMTSolver> SMT;
+	OwningPtr<ValueGen> VG;
+	OwningPtr<PathGen> PG;
+
 	SmallVector<PathGen::Edge, 32> BackEdges;
 	SmallPtrSet<Value *, 32> ReportedBugs;
 
 	void runOnFunction(Function &);
+	void newSession();
 	void check(CallInst *);
 	void classify(Value *);
-	SMTStatus query(Value *, Instruction *);
+	SMTStatus query(SMTExpr, Instruction *);
+	void report(Instruction *, SMTStatus, SMTModel);
 };
 
 } // anonymous namespace
@@ -69,6 +82,7 @@ bool IntSat::runOnModule(Module &M) {
 	if (!Trap)
 		return false;
 	TD.reset(new DataLayout(&M));
+	RG.reset(new RangeGen(*TD));
 	MD_bug = M.getContext().getMDKindID("bug");
 	for (Module::iterator i = M.begin(), e = M.end(); i != e; ++i) {
 		Function &F = *i;
@@ -76,6 +90,9 @@ bool IntSat::runOnModule(Module &M) {
 			continue;
 		runOnFunction(F);
 	}
+	PG.reset();
+	VG.reset();
+	SMT.reset();
 	return false;
 }
 
@@ -83,6 +100,8 @@ void IntSat::runOnFunction(Function &F) {
 	BackEdges.clear();
 	FindFunctionBackedges(F, BackEdges);
 	ReportedBugs.clear();
+	RG->clear();
+	newSession();
 	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
 		CallInst *CI = dyn_cast<CallInst>(&*i);
 		if (CI && CI->getCalledFunction() == Trap)
@@ -105,26 +124,60 @@ void IntSat::check(CallInst *I) {
 	if (!I->getMetadata(MD_bug))
 		return;
 
+	// Intervals and known bits of the inputs may already rule out
+	// the condition, whatever the path.
+	if (RG->isFalse(V)) {
+		++NumDischarged;
+		return;
+	}
+
+	// Build the formula before forking, so that a forked solver does
+	// not take the shared expressions away with it.
+	SMTExpr Query = SMT->bvand(VG->get(V), PG->get(I->getParent()));
+	// Inlined header code repeats checks across modules; a model
+	// needs a solver, though.
+	uint64_t Check = 0;
+	uint64_t Key = SMTModelOpt ? 0 : SMT->hash(Query, &Check);
 	int SMTRes;
-	if (SMTFork() == 0)
-		SMTRes = query(V, I);
-	SMTJoin(&SMTRes);
+	if (SMTCacheLookup(Key, Check, &SMTRes)) {
+		if (SMTRes == SMT_SAT)
+			report(I, SMT_SAT, NULL);
+	} else {
+		if (SMTFork() == 0)
+			SMTRes = query(Query, I);
+		SMTJoin(&SMTRes);
+		SMTCacheInsert(Key, Check, SMTRes);
+	}
+	SMT->decref(Query);
+	// A stopped solver may not answer again.
+	if (SMT->interrupted() && !SMT->resumable())
+		newSession();
 
 	// Save to suppress furture warnings.
 	if (SMTRes == SMT_SAT)
 		ReportedBugs.insert(V);
 }
 
-SMTStatus IntSat::query(Value *V, Instruction *I) {
-	SMTSolver SMT(SMTModelOpt);
-	ValueGen VG(*TD, SMT);
-	PathGen PG(VG, BackEdges);
-	SMTExpr Query = SMT.bvand(VG.get(V), PG.get(I->getParent()));
+void IntSat::newSession() {
+	// Release expressions before their solver.
+	PG.reset();
+	VG.reset();
+	SMT.reset(SMTSolver::create(SMTModelOpt));
+	VG.reset(new ValueGen(*TD, *SMT));
+	PG.reset(new PathGen(*VG, BackEdges));
+}
+
+SMTStatus IntSat::query(SMTExpr Query, Instruction *I) {
 	SMTModel Model = NULL;
-	SMTStatus Res = SMT.query(Query, &Model);
-	SMT.decref(Query);
-	if (Res != SMT_SAT)
-		return Res;
+	SMTStatus Res = SMT->query(Query, &Model);
+	if (Res == SMT_SAT)
+		report(I, Res, Model);
+	if (Model)
+		SMT->release(Model);
+	return Res;
+}
+
+void IntSat::report(Instruction *I, SMTStatus Res, SMTModel Model) {
 	// Output bug type.
 	MDNode *MD = I->getMetadata(MD_bug);
 	Diag.bug(cast<MDString>(MD->getOperand(0))->getString());
@@ -136,7 +189,7 @@ SMTStatus IntSat::query(Value *V, Instruction *I) {
 	if (SMTModelOpt && Model) {
 		Diag << "model: |\n";
 		raw_ostream &OS = Diag.os();
-		for (ValueGen::iterator i = VG.begin(), e = VG.end(); i != e; ++i) {
+		for (ValueGen::iterator i = VG->begin(), e = VG->end(); i != e; ++i) {
 			Value *KeyV = i->first;
 			if (isa<Constant>(KeyV))
 				continue;
@@ -144,16 +197,13 @@ SMTStatus IntSat::query(Value *V, Instruction *I) {
 			WriteAsOperand(OS, KeyV, false, Trap->getParent());
 			OS << ": ";
 			APInt Val;
-			SMT.eval(Model, i->second, Val);
+			SMT->eval(Model, i->second, Val);
 			if (Val.getLimitedValue(0xa) == 0xa)
 				OS << "0x";
 			OS << Val.toString(16, false);
 			OS << '\n';
 		}
 	}
-	if (Model)
-		SMT.release(Model);
-	return Res;
 }
 
 char IntSat::ID;
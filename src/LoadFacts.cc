@@ -0,0 +1,60 @@
+// This pass loads the results of intglobal from the sidecar file of the
+// module, if any, so that later passes (int-sat and the diagnostics)
+// see the same metadata as in a module written back by intglobal.
+
+#define DEBUG_TYPE "load-facts"
+#include <llvm/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/system_error.h>
+
+#include "Annotation.h"
+#include "Sidecar.h"
+#include "WordFile.h"
+
+using namespace llvm;
+
+namespace {
+
+struct LoadFacts : ModulePass {
+	static char ID;
+	LoadFacts() : ModulePass(ID) { }
+
+	virtual bool runOnModule(Module &);
+};
+
+} // anonymous namespace
+
+bool LoadFacts::runOnModule(Module &M) {
+	std::string Path = getSidecarPath(M.getModuleIdentifier());
+	bool Exists;
+	if (sys::fs::exists(Path, Exists) || !Exists)
+		return false;
+
+	// the facts hold only for the contents they were computed from
+	OwningPtr<MemoryBuffer> MB;
+	if (error_code ec = MemoryBuffer::getFile(M.getModuleIdentifier(), MB)) {
+		errs() << "load-facts: " << M.getModuleIdentifier() << ": "
+		       << ec.message() << "\n";
+		return false;
+	}
+	uint64_t Hash = hashBytes(MB->getBuffer());
+	MB.reset();
+
+	// redo the annotation of intglobal, so that instructions line up
+	for (Module::iterator i = M.begin(), e = M.end(); i != e; ++i)
+		annotateFunction(*i);
+
+	std::string Err;
+	if (!readSidecar(&M, Hash, Path, Err))
+		errs() << "load-facts: " << Path << ": " << Err << "\n";
+	return true;
+}
+
+char LoadFacts::ID;
+
+static RegisterPass<LoadFacts>
+X("load-facts", "Load intglobal facts from the sidecar file");
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <llvm/ADT/DenseMapInfo.h>
+#include <functional>
+
+// A map with structural sharing, for per-block facts that mostly equal
+// those of a predecessor.  Copies share all nodes; an update copies only
+// the path to the changed entry.  The map is a treap whose priorities are
+// hashes of the keys, so its shape depends only on the set of keys, and
+// joining maps that share subtrees skips the shared parts.
+//
+// Nodes are reference counted without locking; a map and its copies
+// belong to one thread.
+template <typename KeyT, typename ValueT>
+class PersistentMap {
+	struct Node {
+		KeyT Key;
+		ValueT Val;
+		Node *L, *R;
+		unsigned Prio;
+		unsigned Refs;
+		Node(KeyT K, const ValueT &V, Node *L_, Node *R_, unsigned P)
+			: Key(K), Val(V), L(L_), R(R_), Prio(P), Refs(1) { }
+	};
+
+public:
+	PersistentMap() : Root(NULL) { }
+	PersistentMap(const PersistentMap &RHS) : Root(retain(RHS.Root)) { }
+	~PersistentMap() { release(Root); }
+
+	PersistentMap &operator=(const PersistentMap &RHS) {
+		Node *Old = Root;
+		Root = retain(RHS.Root);
+		release(Old);
+		return *this;
+	}
+
+	bool empty() const { return !Root; }
+
+	void clear() {
+		release(Root);
+		Root = NULL;
+	}
+
+	const ValueT *find(KeyT K) const {
+		for (Node *N = Root; N; ) {
+			if (K == N->Key)
+				return &N->Val;
+			N = less(K, N->Key) ? N->L : N->R;
+		}
+		return NULL;
+	}
+
+	// insert K unless it is present; return true if inserted
+	bool insert(KeyT K, const ValueT &V) {
+		if (find(K))
+			return false;
+		Node *Old = Root;
+		Root = insert(Old, K, V, hash(K));
+		release(Old);
+		return true;
+	}
+
+	// set the value of K, which must be present
+	void set(KeyT K, const ValueT &V) {
+		Node *Old = Root;
+		Root = assign(Old, K, V);
+		release(Old);
+	}
+
+	// Add the entries of RHS, combining values of keys in both maps with
+	// Join(Val, RHSVal), which returns true if Val changed.  Join must
+	// leave a value unchanged when combined with itself.
+	template <typename JoinT>
+	void join(const PersistentMap &RHS, JoinT Join) {
+		Node *Old = Root;
+		Root = join(Old, RHS.Root, Join);
+		release(Old);
+	}
+
+private:
+	Node *Root;
+
+	static unsigned hash(KeyT K) {
+		unsigned H = llvm::DenseMapInfo<KeyT>::getHashValue(K);
+		H *= 0x9e3779b9u;
+		return H ^ (H >> 16);
+	}
+
+	static bool less(KeyT A, KeyT B) {
+		return std::less<KeyT>()(A, B);
+	}
+
+	// whether a node of (P, K) belongs above one of (Q, KQ)
+	static bool above(unsigned P, KeyT K, unsigned Q, KeyT KQ) {
+		return P > Q || (P == Q && less(K, KQ));
+	}
+
+	static Node *retain(Node *N) {
+		if (N)
+			++N->Refs;
+		return N;
+	}
+
+	static void release(Node *N) {
+		if (!N || --N->Refs)
+			return;
+		release(N->L);
+		release(N->R);
+		delete N;
+	}
+
+	// Functions below return a new reference and leave their arguments'
+	// references alone, unless noted.
+
+	// node (K, V) over L and R, taking their references
+	static Node *make(KeyT K, const ValueT &V, Node *L, Node *R) {
+		return new Node(K, V, L, R, hash(K));
+	}
+
+	// split T into keys below and above K, and the value of K if any
+	static void split(Node *T, KeyT K, Node *&L, Node *&R,
+	                  const ValueT *&Mid) {
+		if (!T) {
+			L = R = NULL;
+			return;
+		}
+		if (K == T->Key) {
+			L = retain(T->L);
+			R = retain(T->R);
+			Mid = &T->Val;
+		} else if (less(K, T->Key)) {
+			Node *M;
+			split(T->L, K, L, M, Mid);
+			R = make(T->Key, T->Val, M, retain(T->R));
+		} else {
+			Node *M;
+			split(T->R, K, M, R, Mid);
+			L = make(T->Key, T->Val, retain(T->L), M);
+		}
+	}
+
+	// insert K, which is not in T
+	static Node *insert(Node *T, KeyT K, const ValueT &V, unsigned P) {
+		if (!T || above(P, K, T->Prio, T->Key)) {
+			Node *L, *R;
+			const ValueT *Mid = NULL;
+			split(T, K, L, R, Mid);
+			return make(K, V, L, R);
+		}
+		if (less(K, T->Key))
+			return make(T->Key, T->Val, insert(T->L, K, V, P), retain(T->R));
+		return make(T->Key, T->Val, retain(T->L), insert(T->R, K, V, P));
+	}
+
+	static Node *assign(Node *T, KeyT K, const ValueT &V) {
+		if (K == T->Key)
+			return make(K, V, retain(T->L), retain(T->R));
+		if (less(K, T->Key))
+			return make(T->Key, T->Val, assign(T->L, K, V), retain(T->R));
+		return make(T->Key, T->Val, retain(T->L), assign(T->R, K, V));
+	}
+
+	// reuse T if its children and value are unchanged
+	static Node *rebuild(Node *T, Node *L, Node *R, const ValueT &V,
+	                     bool Changed) {
+		if (!Changed && L == T->L && R == T->R) {
+			release(L);
+			release(R);
+			return retain(T);
+		}
+		return make(T->Key, V, L, R);
+	}
+
+	template <typename JoinT>
+	static Node *join(Node *A, Node *B, JoinT &Join) {
+		if (A == B || !B)
+			return retain(A);
+		if (!A)
+			return retain(B);
+
+		Node *L, *R;
+		const ValueT *Mid = NULL;
+		if (above(A->Prio, A->Key, B->Prio, B->Key)) {
+			split(B, A->Key, L, R, Mid);
+			Node *JL = join(A->L, L, Join);
+			Node *JR = join(A->R, R, Join);
+			release(L);
+			release(R);
+			ValueT V = A->Val;
+			bool Changed = Mid && Join(V, *Mid);
+			return rebuild(A, JL, JR, V, Changed);
+		}
+
+		split(A, B->Key, L, R, Mid);
+		Node *JL = join(L, B->L, Join);
+		Node *JR = join(R, B->R, Join);
+		release(L);
+		release(R);
+		if (!Mid)
+			return rebuild(B, JL, JR, B->Val, false);
+		ValueT V = *Mid;
+		Join(V, B->Val);
+		return make(B->Key, V, JL, JR);
+	}
+};
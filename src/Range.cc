@@ -16,6 +16,7 @@
 #include <llvm/Module.h>
 #include <llvm/Constants.h>
 #include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/PostOrderIterator.h>
 #include <llvm/ADT/StringExtras.h>
 #include <llvm/DebugInfo.h>
 #include <llvm/Analysis/CallGraph.h>
@@ -34,49 +35,87 @@ static cl::opt<std::string>
 WatchID("w", cl::desc("Watch sID"), 
 			   cl::value_desc("sID"));
 
-bool RangePass::unionRange(StringRef sID, const CRange &R,
+static cl::opt<bool>
+SparseRanges("sparse-ranges",
+             cl::desc("Propagate ranges along def-use edges instead of "
+                      "keeping ranges per block"));
+
+static cl::opt<bool>
+Narrow("range-narrowing",
+       cl::desc("Narrow widened ranges once all ranges are stable"));
+
+bool RangePass::unionRange(GlobalID sID, const CRange &R,
 						   Value *V = NULL)
 {
-	if (R.isEmptySet())
+	if (R.isEmptySet() || !sID)
 		return false;
 	
-	if (WatchID == sID && V) {
+	bool watch = !WatchID.empty() && Ctx->Ids.getName(sID) == WatchID;
+	if (watch && V) {
 		if (Instruction *I = dyn_cast<Instruction>(V))
 			dbgs() << I->getParent()->getParent()->getName() << "(): ";
 		V->print(dbgs());
 		dbgs() << "\n";
 	}
 	
+	// keep the union of stored ranges, which widening may exceed
+	if (Narrow && !Ctx->RawRanges.insert(sID, R))
+		Ctx->RawRanges[sID].safeUnion(R);
+
 	bool changed = true;
-	RangeMap::iterator it = Ctx->IntRanges.find(sID);
-	if (it != Ctx->IntRanges.end()) {
-		changed = it->second.safeUnion(R);
-		if (changed && sID == WatchID)
-			dbgs() << sID << " + " << R << " = " << it->second << "\n";
+	if (Ctx->IntRanges.count(sID)) {
+		CRange &CR = Ctx->IntRanges[sID];
+		if (Unstable.count(sID)
+		    || Grown.count(std::make_pair(sID, getCurrentModule()))) {
+			CRange Old = CR;
+			changed = CR.safeUnion(R);
+			if (changed)
+				CR = widen(Old, CR);
+		} else {
+			changed = CR.safeUnion(R);
+		}
+		if (changed && watch)
+			dbgs() << WatchID << " + " << R << " = " << CR << "\n";
 	} else {
-		Ctx->IntRanges.insert(std::make_pair(sID, R));
-		if (sID == WatchID)
-			dbgs() << sID << " = " << R << "\n";
+		Ctx->IntRanges.insert(sID, R);
+		if (watch)
+			dbgs() << WatchID << " = " << R << "\n";
 	}
-	if (changed)
+	if (changed) {
 		Changes.insert(sID);
+		addWrite(sID);
+	}
 	return changed;
 }
 
+namespace {
+
+struct JoinRange {
+	bool operator()(CRange &CR, const CRange &R) const {
+		return CR.safeUnion(R);
+	}
+};
+
+} // anonymous namespace
+
 bool RangePass::unionRange(BasicBlock *BB, Value *V,
 						   const CRange &R)
 {
 	if (R.isEmptySet())
 		return false;
+	if (DT)
+		return unionName(NULL, V, R);
 	
-	bool changed = true;
 	ValueRangeMap &VRM = FuncVRMs[BB];
-	ValueRangeMap::iterator it = VRM.find(V);
-	if (it != VRM.end())
-		changed = it->second.safeUnion(R);
-	else
-		VRM.insert(std::make_pair(V, R));
-	return changed;
+	if (const CRange *Old = VRM.find(V)) {
+		CRange CR = *Old;
+		if (!CR.safeUnion(R))
+			return false;
+		VRM.set(V, CR);
+		return true;
+	}
+	VRM.insert(V, R);
+	return true;
 }
 
 CRange RangePass::getRange(BasicBlock *BB, Value *V)
@@ -85,11 +124,12 @@ CRange RangePass::getRange(BasicBlock *BB, Value *V)
 	if (ConstantInt *C = dyn_cast<ConstantInt>(V))
 		return CRange(C->getValue());
 	
-	ValueRangeMap &VRM = FuncVRMs[BB];
-	ValueRangeMap::iterator invrm = VRM.find(V);
-	
-	if (invrm != VRM.end())
-		return invrm->second;
+	if (DT) {
+		if (const CRange *CR = lookupName(BB, V))
+			return *CR;
+	} else if (const CRange *CR = FuncVRMs[BB].find(V)) {
+		return *CR;
+	}
 	
 	// V must be integer or pointer to integer
 	IntegerType *Ty = dyn_cast<IntegerType>(V->getType());
@@ -101,48 +141,89 @@ CRange RangePass::getRange(BasicBlock *BB, Value *V)
 	CRange CR(Ty->getBitWidth(), false);
 	CRange Fullset(Ty->getBitWidth(), true);
 	
-	RangeMap &IRM = Ctx->IntRanges;
-	TaintPass TI(Ctx);
+	const RangeMap &IRM = Ctx->IntRanges;
+	const TaintMap &TM = Ctx->Taints;
 	
 	if (CallInst *CI = dyn_cast<CallInst>(V)) {
 		// calculate union of values ranges returned by all possible callees
-		if (!CI->isInlineAsm() && Ctx->Callees.count(CI)) {
-			FuncSet &CEEs = Ctx->Callees[CI];
-			for (FuncSet::iterator i = CEEs.begin(), e = CEEs.end();
+		const FuncSet *CEEs = Ctx->getCallees(CI);
+		if (!CI->isInlineAsm() && CEEs) {
+			for (FuncSet::iterator i = CEEs->begin(), e = CEEs->end();
 				 i != e; ++i) {
-				std::string sID = getRetId(*i);
-				if (sID != "" && TI.isTaintSource(sID)) {
+				GlobalID sID = Ctx->FuncTab.getRetId(*i);
+				addRead(sID);
+				if (sID && TM.isSource(sID)) {
 					CR = Fullset;
 					break;
 				}
-				RangeMap::iterator it;
-				if ((it = IRM.find(sID)) != IRM.end())
-					CR.safeUnion(it->second);
+				if (const CRange *R = IRM.find(sID))
+					CR.safeUnion(*R);
 			}
 		}
 	} else {
 		// arguments & loads
-		std::string sID = getValueId(V);
-		if (sID != "") {
-			RangeMap::iterator it;
-			if (TI.isTaintSource(sID))
+		GlobalID sID = Ctx->Ids.getValueId(V);
+		if (sID) {
+			addRead(sID);
+			if (TM.isSource(sID))
 				CR = Fullset;
-			else if ((it = IRM.find(sID)) != IRM.end())
-				CR = it->second;
+			else if (const CRange *R = IRM.find(sID))
+				CR = *R;
 		}
 		// might load part of a struct field
 		CR = CR.zextOrTrunc(Ty->getBitWidth());
 	}
-	if (!CR.isEmptySet())
-		VRM.insert(std::make_pair(V, CR));
+	if (!CR.isEmptySet()) {
+		if (DT)
+			unionName(NULL, V, CR);
+		else
+			FuncVRMs[BB].insert(V, CR);
+	}
 	return CR;
 }
 
+const CRange *RangePass::findName(BasicBlock *BB, Value *V)
+{
+	DenseMap<Name, unsigned>::iterator it = NameIndex.find(Name(BB, V));
+	if (it == NameIndex.end())
+		return NULL;
+	return &NameRanges[it->second];
+}
+
+bool RangePass::unionName(BasicBlock *BB, Value *V, const CRange &R)
+{
+	std::pair<DenseMap<Name, unsigned>::iterator, bool> Ins =
+		NameIndex.insert(std::make_pair(Name(BB, V), NameRanges.size()));
+	if (Ins.second) {
+		NameRanges.push_back(R);
+		return true;
+	}
+	return NameRanges[Ins.first->second].safeUnion(R);
+}
+
+// the innermost refinement of V on the dominator path to BB, or the
+// range of V itself
+const CRange *RangePass::lookupName(BasicBlock *BB, Value *V)
+{
+	if (Refined.count(V)) {
+		Instruction *I = dyn_cast<Instruction>(V);
+		BasicBlock *Def = I ? I->getParent() : NULL;
+		for (DomTreeNode *N = DT->getNode(BB); N; N = N->getIDom()) {
+			BasicBlock *B = N->getBlock();
+			if (B == Def)
+				break;
+			if (const CRange *CR = findName(B, V))
+				return CR;
+		}
+	}
+	return findName(NULL, V);
+}
+
 void RangePass::collectInitializers(GlobalVariable *GV, Constant *I)
 {	
 	// global var
 	if (ConstantInt *CI = dyn_cast<ConstantInt>(I)) {
-		unionRange(getVarId(GV), CI->getValue(), GV);
+		unionRange(Ctx->Ids.get(getVarId(GV)), CI->getValue(), GV);
 	}
 	
 	// structs
@@ -163,8 +244,9 @@ void RangePass::collectInitializers(GlobalVariable *GV, Constant *I)
 			} else if (Ty->isIntegerTy()) {
 				ConstantInt *CI = 
 					dyn_cast<ConstantInt>(I->getOperand(i));
-				StringRef sID = getStructId(ST, GV->getParent(), i);
-				if (!sID.empty() && CI)
+				GlobalID sID = Ctx->Ids.get(
+					getStructId(ST, GV->getParent(), i));
+				if (sID && CI)
 					unionRange(sID, CI->getValue(), GV);
 			}
 		}
@@ -180,6 +262,88 @@ void RangePass::collectInitializers(GlobalVariable *GV, Constant *I)
 	}
 }
 
+static void addThreshold(std::vector<int64_t> &T, ConstantInt *C)
+{
+	if (C->getBitWidth() > 64)
+		return;
+	int64_t V = C->getSExtValue();
+	T.push_back(V);
+	// bounds of values that are compared strictly
+	if (V != INT64_MIN)
+		T.push_back(V - 1);
+	if (V != INT64_MAX)
+		T.push_back(V + 1);
+}
+
+void RangePass::collectThresholds(Module *M)
+{
+	Thresholds.clear();
+	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
+		for (inst_iterator i = inst_begin(&*f), e = inst_end(&*f);
+			 i != e; ++i) {
+			Instruction *I = &*i;
+			if (isa<ICmpInst>(I)) {
+				for (unsigned j = 0; j != 2; ++j)
+					if (ConstantInt *C = dyn_cast<ConstantInt>(I->getOperand(j)))
+						addThreshold(Thresholds, C);
+			} else if (SwitchInst *SI = dyn_cast<SwitchInst>(I)) {
+				for (SwitchInst::CaseIt c = SI->case_begin(),
+					 ce = SI->case_end(); c != ce; ++c)
+					addThreshold(Thresholds, c.getCaseValue());
+			}
+		}
+	}
+	std::sort(Thresholds.begin(), Thresholds.end());
+	Thresholds.erase(std::unique(Thresholds.begin(), Thresholds.end()),
+					 Thresholds.end());
+}
+
+//
+// Widen Old, which New includes, by moving each bound of New beyond Old
+// to the next threshold, or to the end of the domain.  Bounds are
+// compared unsigned, or signed if New wraps around in unsigned order.
+// Thresholds are finite, so ranges widened this way stop growing.
+//
+CRange RangePass::widen(const CRange &Old, const CRange &New)
+{
+	if (Old.isEmptySet() || New.isFullSet())
+		return New;
+
+	unsigned Bits = New.getBitWidth();
+	bool Signed = New.isWrappedSet();
+	APInt Lo = Signed ? New.getSignedMin() : New.getUnsignedMin();
+	APInt Hi = Signed ? New.getSignedMax() : New.getUnsignedMax();
+	APInt OldLo = Signed ? Old.getSignedMin() : Old.getUnsignedMin();
+	APInt OldHi = Signed ? Old.getSignedMax() : Old.getUnsignedMax();
+	bool Down = Signed ? Lo.slt(OldLo) : Lo.ult(OldLo);
+	bool Up = Signed ? Hi.sgt(OldHi) : Hi.ugt(OldHi);
+	APInt NewLo = Signed ? APInt::getSignedMinValue(Bits)
+						 : APInt::getMinValue(Bits);
+	APInt NewHi = Signed ? APInt::getSignedMaxValue(Bits)
+						 : APInt::getMaxValue(Bits);
+
+	for (unsigned i = 0; i != Thresholds.size(); ++i) {
+		APInt T(64, Thresholds[i], true);
+		if (!T.isSignedIntN(Bits) && !T.isIntN(Bits))
+			continue;
+		T = T.sextOrTrunc(Bits);
+		if (Down && (Signed ? T.sle(Lo) && T.sgt(NewLo)
+							: T.ule(Lo) && T.ugt(NewLo)))
+			NewLo = T;
+		if (Up && (Signed ? T.sge(Hi) && T.slt(NewHi)
+						  : T.uge(Hi) && T.ult(NewHi)))
+			NewHi = T;
+	}
+	if (Down)
+		Lo = NewLo;
+	if (Up)
+		Hi = NewHi;
+	++Hi;
+	if (Lo == Hi)
+		return CRange(Bits, true);
+	return CRange(Lo, Hi);
+}
+
 //
 // Handle integer assignments in global initializers
 //
@@ -202,22 +366,7 @@ CRange RangePass::visitBinaryOp(BinaryOperator *BO)
 	CRange L = getRange(BO->getParent(), BO->getOperand(0));
 	CRange R = getRange(BO->getParent(), BO->getOperand(1));
 	R.match(L);
-	switch (BO->getOpcode()) {
-		default: BO->dump(); llvm_unreachable("Unknown binary operator!");
-		case Instruction::Add:  return L.add(R);
-		case Instruction::Sub:  return L.sub(R);
-		case Instruction::Mul:  return L.multiply(R);
-		case Instruction::UDiv: return L.udiv(R);
-		case Instruction::SDiv: return L.sdiv(R);
-		case Instruction::URem: return R; // FIXME
-		case Instruction::SRem: return R; // FIXME
-		case Instruction::Shl:  return L.shl(R);
-		case Instruction::LShr: return L.lshr(R);
-		case Instruction::AShr: return L; // FIXME
-		case Instruction::And:  return L.binaryAnd(R);
-		case Instruction::Or:   return L.binaryOr(R);
-		case Instruction::Xor:  return L; // FIXME
-	}
+	return L.binaryOp(BO->getOpcode(), R);
 }
 
 
@@ -226,15 +375,10 @@ CRange RangePass::visitCastInst(CastInst *CI)
 	unsigned bits = dyn_cast<IntegerType>(
 								CI->getDestTy())->getBitWidth();
 	
-	BasicBlock *BB = CI->getParent();
 	Value *V = CI->getOperand(0);
-	switch (CI->getOpcode()) {
-		case CastInst::Trunc:    return getRange(BB, V).zextOrTrunc(bits);
-		case CastInst::ZExt:     return getRange(BB, V).zextOrTrunc(bits);
-		case CastInst::SExt:     return getRange(BB, V).signExtend(bits);
-		case CastInst::BitCast:  return getRange(BB, V);
-		default:                 return CRange(bits, true);
-	}
+	if (!V->getType()->isIntegerTy())
+		return CRange(bits, true);
+	return getRange(CI->getParent(), V).castOp(CI->getOpcode(), bits);
 }
 
 CRange RangePass::visitSelectInst(SelectInst *SI)
@@ -263,15 +407,16 @@ CRange RangePass::visitPHINode(PHINode *PHI)
 bool RangePass::visitCallInst(CallInst *CI)
 {
 	bool changed = false;
-	if (CI->isInlineAsm() || Ctx->Callees.count(CI) == 0)
+	const FuncSet *CEEs = Ctx->getCallees(CI);
+	if (CI->isInlineAsm() || !CEEs)
 		return false;
 
 	// update arguments of all possible callees
-	FuncSet &CEEs = Ctx->Callees[CI];
-	for (FuncSet::iterator i = CEEs.begin(), e = CEEs.end(); i != e; ++i) {
+	for (FuncSet::iterator i = CEEs->begin(), e = CEEs->end();
+	     i != e; ++i) {
 		// skip vaarg and builtin functions
-		if ((*i)->isVarArg() 
-			|| (*i)->getName().find('.') != StringRef::npos)
+		const FuncInfo &FI = Ctx->FuncTab[*i];
+		if (FI.isVarArg || FI.Name.find('.') != StringRef::npos)
 			continue;
 		
 		for (unsigned j = 0; j < CI->getNumArgOperands(); ++j) {
@@ -279,21 +424,22 @@ bool RangePass::visitCallInst(CallInst *CI)
 			// skip non-integer arguments
 			if (!V->getType()->isIntegerTy())
 				continue;
-			std::string sID = getArgId(*i, j);
+			GlobalID sID = Ctx->FuncTab.getArgId(*i, j);
 			changed |= unionRange(sID, getRange(CI->getParent(), V), CI);
 		}
 	}
 	// range for the return value of this call site
 	if (CI->getType()->isIntegerTy())
-		changed |= unionRange(getRetId(CI), getRange(CI->getParent(), CI), CI);
+		changed |= unionRange(Ctx->Ids.getRetId(CI),
+		                      getRange(CI->getParent(), CI), CI);
 	return changed;
 }
 
 bool RangePass::visitStoreInst(StoreInst *SI)
 {
-	std::string sID = getValueId(SI);
+	GlobalID sID = Ctx->Ids.getValueId(SI);
 	Value *V = SI->getValueOperand();
-	if (V->getType()->isIntegerTy() && sID != "") {
+	if (V->getType()->isIntegerTy() && sID) {
 		CRange CR = getRange(SI->getParent(), V);
 		unionRange(SI->getParent(), SI->getPointerOperand(), CR);
 		return unionRange(sID, CR, SI);
@@ -307,7 +453,7 @@ bool RangePass::visitReturnInst(ReturnInst *RI)
 	if (!V || !V->getType()->isIntegerTy())
 		return false;
 	
-	std::string sID = getRetId(RI->getParent()->getParent());
+	GlobalID sID = Ctx->Ids.getRetId(RI->getParent()->getParent());
 	return unionRange(sID, getRange(RI->getParent(), V), RI);
 }
 
@@ -355,7 +501,7 @@ bool RangePass::isBackEdge(const Edge &E)
 }
 
 void RangePass::visitBranchInst(BranchInst *BI, BasicBlock *BB, 
-								ValueRangeMap &VRM)
+								RangeList &Refs)
 {
 	if (!BI->isConditional())
 		return;
@@ -380,8 +526,8 @@ void RangePass::visitBranchInst(BranchInst *BI, BasicBlock *BB,
 									ICI->getSwappedPredicate(), LCR);
 		CRange PRCR = CRange::makeICmpRegion(
 									ICI->getPredicate(), RCR);
-		VRM.insert(std::make_pair(LHS, LCR.intersectWith(PRCR)));
-		VRM.insert(std::make_pair(RHS, LCR.intersectWith(PLCR)));
+		Refs.push_back(std::make_pair(LHS, LCR.intersectWith(PRCR)));
+		Refs.push_back(std::make_pair(RHS, LCR.intersectWith(PLCR)));
 	} else {
 		// false target, use inverse predicate
 		// N.B. why there's no getSwappedInversePredicate()...
@@ -391,13 +537,13 @@ void RangePass::visitBranchInst(BranchInst *BI, BasicBlock *BB,
 		ICI->swapOperands();
 		CRange PRCR = CRange::makeICmpRegion(
 									ICI->getInversePredicate(), RCR);
-		VRM.insert(std::make_pair(LHS, LCR.intersectWith(PRCR)));
-		VRM.insert(std::make_pair(RHS, LCR.intersectWith(PLCR)));
+		Refs.push_back(std::make_pair(LHS, LCR.intersectWith(PRCR)));
+		Refs.push_back(std::make_pair(RHS, LCR.intersectWith(PLCR)));
 	}
 }
 
 void RangePass::visitSwitchInst(SwitchInst *SI, BasicBlock *BB, 
-								ValueRangeMap &VRM)
+								RangeList &Refs)
 {
 	Value *V = SI->getCondition();
 	IntegerType *Ty = dyn_cast<IntegerType>(V->getType());
@@ -421,15 +567,15 @@ void RangePass::visitSwitchInst(SwitchInst *SI, BasicBlock *BB,
 			CR.safeUnion(i.getCaseValue()->getValue());
 		CR = CR.inverse();
 	}
-	VRM.insert(std::make_pair(V, VCR.intersectWith(CR)));
+	Refs.push_back(std::make_pair(V, VCR.intersectWith(CR)));
 }
 
 void RangePass::visitTerminator(TerminatorInst *I, BasicBlock *BB,
-								 ValueRangeMap &VRM) {
+								 RangeList &Refs) {
 	if (BranchInst *BI = dyn_cast<BranchInst>(I))
-		visitBranchInst(BI, BB, VRM);
+		visitBranchInst(BI, BB, Refs);
 	else if (SwitchInst *SI = dyn_cast<SwitchInst>(I))
-		visitSwitchInst(SI, BB, VRM);
+		visitSwitchInst(SI, BB, Refs);
 	else if (isa<ResumeInst>(I))
 		llvm_unreachable("'resume' shouldn't have any successor.");
 	else if (isa<UnreachableInst>(I))
@@ -460,23 +606,16 @@ bool RangePass::updateRangeFor(BasicBlock *BB)
 		if (isBackEdge(Edge(Pred, BB)))
 			continue;
 		
-		ValueRangeMap &PredVRM = FuncVRMs[Pred];
-		ValueRangeMap &BBVRM = FuncVRMs[BB];
-		
-		// Copy from its predecessor
-		ValueRangeMap VRM(PredVRM.begin(), PredVRM.end());
+		// Share the map of its predecessor
+		ValueRangeMap VRM(FuncVRMs[Pred]);
 		// Refine according to the terminator
-		visitTerminator(Pred->getTerminator(), BB, VRM);
+		RangeList Refs;
+		visitTerminator(Pred->getTerminator(), BB, Refs);
+		for (unsigned j = 0; j != Refs.size(); ++j)
+			VRM.insert(Refs[j].first, Refs[j].second);
 		
 		// union with other predecessors
-		for (ValueRangeMap::iterator j = VRM.begin(), je = VRM.end();
-			 j != je; ++j) {
-			ValueRangeMap::iterator it = BBVRM.find(j->first);
-			if (it != BBVRM.end())
-				it->second.safeUnion(j->second);
-			else
-				BBVRM.insert(*j);
-		}
+		FuncVRMs[BB].join(VRM, JoinRange());
 	}
 	
 	// Now run through instructions
@@ -495,6 +634,8 @@ bool RangePass::updateRangeFor(Function *F)
 	FuncVRMs.clear();
 	BackEdges.clear();
 	FindFunctionBackedges(*F, BackEdges);
+	if (SparseRanges)
+		return updateSparseRangeFor(F);
 	
 	for (Function::iterator b = F->begin(), be = F->end(); b != be; ++b)
 		changed |= updateRangeFor(&*b);
@@ -502,30 +643,123 @@ bool RangePass::updateRangeFor(Function *F)
 	return changed;
 }
 
+bool RangePass::updateSparseRangeFor(Function *F)
+{
+	bool changed = false;
+
+	DominatorTreeBase<BasicBlock> DomTree(false);
+	DomTree.recalculate(*F);
+	DT = &DomTree;
+	NameIndex.clear();
+	NameRanges.clear();
+	Refined.clear();
+
+	// predecessors are visited first, except along back edges
+	ReversePostOrderTraversal<Function *> RPOT(F);
+	for (ReversePostOrderTraversal<Function *>::rpo_iterator
+		 b = RPOT.begin(), be = RPOT.end(); b != be; ++b) {
+		BasicBlock *BB = *b;
+
+		// Name values refined on entry to BB.  Refinements are dropped
+		// at merge points, unlike the dense engine, which joins them.
+		BasicBlock *Pred = NULL;
+		bool Merge = false;
+		for (pred_iterator i = pred_begin(BB), e = pred_end(BB);
+			 i != e && !Merge; ++i) {
+			if (isBackEdge(Edge(*i, BB)) || *i == Pred)
+				continue;
+			Merge = Pred != NULL;
+			Pred = *i;
+		}
+		if (Pred && !Merge) {
+			RangeList Refs;
+			visitTerminator(Pred->getTerminator(), BB, Refs);
+			for (unsigned i = 0; i != Refs.size(); ++i) {
+				Value *V = Refs[i].first;
+				if (isa<Constant>(V) || findName(BB, V))
+					continue;
+				unionName(BB, V, Refs[i].second);
+				Refined.insert(V);
+			}
+		}
+
+		for (BasicBlock::iterator i = BB->begin(), e = BB->end();
+			 i != e; ++i)
+			changed |= updateRangeFor(&*i);
+	}
+
+	DT = NULL;
+	return changed;
+}
+
+// Iterate within recursive components, at most MaxIterations times per
+// round; doModulePass widens what keeps changing
+bool RangePass::updateRangeFor(const FuncSCC &S)
+{
+	bool changed = true, ret = false;
+	for (unsigned itr = 0; changed && itr < MaxIterations; ++itr) {
+		changed = false;
+		for (unsigned i = 0; i != S.Funcs.size(); ++i)
+			changed |= updateRangeFor(S.Funcs[i]);
+		ret |= changed;
+		if (!S.Recursive)
+			break;
+	}
+	return ret;
+}
+
 bool RangePass::doModulePass(Module *M)
 {
 	unsigned itr = 0;
 	bool changed = true, ret = false;
+	ChangeSet Grew;
 
+	std::vector<FuncSCC> SCCs;
+	getFuncSCCs(M, SCCs);
+	collectThresholds(M);
+	Unstable.clear();
 	while (changed) {
-		// if some values converge too slowly, expand them to full-set
+		// values that changed in the previous iteration are widened to
+		// thresholds if they grow again; if some values still converge
+		// too slowly, expand them to full-set
 		if (++itr > MaxIterations) {
 			for (ChangeSet::iterator it = Changes.begin(), ie = Changes.end();
 				 it != ie; ++it) {
-				RangeMap::iterator i = Ctx->IntRanges.find(*it);
-				i->second = CRange(i->second.getBitWidth(), true);
+				CRange &R = Ctx->IntRanges[*it];
+				R = CRange(R.getBitWidth(), true);
 			}
 		}
 		changed = false;
+		Unstable.swap(Changes);
 		Changes.clear();
-		for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i)
-			if (!i->empty())
-				changed |= updateRangeFor(&*i);
+		for (unsigned i = 0; i != SCCs.size(); ++i)
+			changed |= updateRangeFor(SCCs[i]);
+		Grew.insert(Changes.begin(), Changes.end());
 		ret |= changed;
 	}
+
+	// widen ranges this module grows again in later rounds
+	unsigned m = getCurrentModule();
+	for (ChangeSet::iterator it = Grew.begin(), ie = Grew.end(); it != ie; ++it)
+		Grown.insert(std::make_pair(*it, m));
 	return ret;
 }
 
+//
+// Widening may leave ranges above anything stored into them.  The union
+// of stored ranges, all computed from ranges no larger than the stable
+// ones, is a sound replacement, which is one narrowing step.
+//
+void RangePass::doFixpoint()
+{
+	if (!Narrow)
+		return;
+	for (GlobalID i = 1, e = Ctx->RawRanges.bound(); i < e; ++i)
+		if (const CRange *R = Ctx->RawRanges.find(i))
+			Ctx->IntRanges[i] = *R;
+	Ctx->RawRanges.clear();
+}
+
 // write back
 bool RangePass::doFinalization(Module *M) {
 	LLVMContext &VMCtx = M->getContext();
@@ -536,14 +770,11 @@ bool RangePass::doFinalization(Module *M) {
 			if (!isa<LoadInst>(I) && !isa<CallInst>(I))
 				continue;
 			I->setMetadata("intrange", NULL);
-			std::string id = getValueId(I);
-			if (id == "")
-				continue;
-			RangeMap &IRM = Ctx->IntRanges;
-			RangeMap::iterator it = IRM.find(id);
-			if (it == IRM.end())
+			GlobalID id = Ctx->Ids.getValueId(I);
+			const CRange *CR = Ctx->IntRanges.find(id);
+			if (!CR)
 				continue;
-			CRange &R = it->second;
+			const CRange &R = *CR;
 			if (R.isEmptySet() || R.isFullSet())
 				continue;
 
@@ -561,9 +792,14 @@ bool RangePass::doFinalization(Module *M) {
 void RangePass::dumpRange()
 {
 	raw_ostream &OS = dbgs();
-	for (RangeMap::iterator i = Ctx->IntRanges.begin(), 
-		e = Ctx->IntRanges.end(); i != e; ++i) {
-		OS << i->first << " " << i->second << "\n";
+	std::vector<GlobalID> Ids;
+	for (GlobalID i = 1, e = Ctx->IntRanges.bound(); i != e; ++i)
+		if (Ctx->IntRanges.count(i))
+			Ids.push_back(i);
+	Ctx->Ids.sort(Ids);
+	for (unsigned i = 0; i != Ids.size(); ++i) {
+		OS << Ctx->Ids.getName(Ids[i]) << " "
+		   << *Ctx->IntRanges.find(Ids[i]) << "\n";
 	}
 }
 
@@ -0,0 +1,305 @@
+#include "RangeGen.h"
+#include <llvm/Constants.h>
+#include <llvm/InstVisitor.h>
+#include <llvm/IntrinsicInst.h>
+#include <llvm/ADT/APInt.h>
+
+using namespace llvm;
+
+typedef RangeGen::Bound Bound;
+
+// Bits shared by all values of a range that does not wrap.
+static void addRangeBits(const ConstantRange &CR, APInt &Zero, APInt &One) {
+	if (CR.isEmptySet() || CR.isFullSet() || CR.isWrappedSet())
+		return;
+	APInt Min = CR.getUnsignedMin(), Max = CR.getUnsignedMax();
+	unsigned N = (Min ^ Max).countLeadingZeros();
+	APInt Mask = APInt::getHighBitsSet(CR.getBitWidth(), N);
+	Zero |= ~Min & Mask;
+	One |= Min & Mask;
+}
+
+RangeGen::Bound::Bound(const ConstantRange &CR)
+	: Range(CR), Zero(CR.getBitWidth(), 0), One(CR.getBitWidth(), 0) {
+	addRangeBits(Range, Zero, One);
+}
+
+RangeGen::Bound::Bound(const ConstantRange &CR, const APInt &Zero_,
+                       const APInt &One_)
+	: Range(CR), Zero(Zero_), One(One_) {
+	unsigned W = getBitWidth();
+	// Conflicting bits, no value.
+	if (!!(Zero & One)) {
+		Range = ConstantRange(W, false);
+		return;
+	}
+	// Values lie within [One, ~Zero].
+	APInt Max = ~Zero;
+	if (!!One || !Max.isMaxValue())
+		Range = Range.intersectWith(ConstantRange(One, Max + 1));
+	addRangeBits(Range, Zero, One);
+}
+
+// Whether L Pred R holds for no values of L and R.
+static bool never(CmpInst::Predicate Pred, const Bound &L, const Bound &R) {
+	if (L.Range.isEmptySet() || R.Range.isEmptySet())
+		return false;
+	ConstantRange Region = ConstantRange::makeICmpRegion(Pred, R.Range);
+	if (L.Range.intersectWith(Region).isEmptySet())
+		return true;
+	// Some bit is known to differ.
+	if (Pred == CmpInst::ICMP_EQ)
+		return !!((L.Zero & R.One) | (L.One & R.Zero));
+	return false;
+}
+
+// Whether an overflow intrinsic may overflow for some values of L and R.
+static bool mayOverflow(Intrinsic::ID ID, const ConstantRange &L,
+                        const ConstantRange &R) {
+	if (L.isEmptySet() || R.isEmptySet())
+		return true;
+	bool Ov = false;
+	switch (ID) {
+	default: return true;
+	case Intrinsic::uadd_with_overflow:
+		L.getUnsignedMax().uadd_ov(R.getUnsignedMax(), Ov);
+		return Ov;
+	case Intrinsic::usub_with_overflow:
+		return L.getUnsignedMin().ult(R.getUnsignedMax());
+	case Intrinsic::umul_with_overflow:
+		L.getUnsignedMax().umul_ov(R.getUnsignedMax(), Ov);
+		return Ov;
+	case Intrinsic::sadd_with_overflow:
+		L.getSignedMax().sadd_ov(R.getSignedMax(), Ov);
+		if (!Ov)
+			L.getSignedMin().sadd_ov(R.getSignedMin(), Ov);
+		return Ov;
+	case Intrinsic::ssub_with_overflow:
+		L.getSignedMax().ssub_ov(R.getSignedMin(), Ov);
+		if (!Ov)
+			L.getSignedMin().ssub_ov(R.getSignedMax(), Ov);
+		return Ov;
+	case Intrinsic::smul_with_overflow: {
+		// Products of the bounds are the extremes.
+		APInt LB[] = { L.getSignedMin(), L.getSignedMax() };
+		APInt RB[] = { R.getSignedMin(), R.getSignedMax() };
+		for (unsigned i = 0; i != 2 && !Ov; ++i)
+			for (unsigned j = 0; j != 2 && !Ov; ++j)
+				LB[i].smul_ov(RB[j], Ov);
+		return Ov;
+	}
+	}
+}
+
+namespace {
+
+#define TD     RG.TD
+
+struct BoundVisitor : InstVisitor<BoundVisitor, Bound> {
+	BoundVisitor(RangeGen &RG)
+		: RG(RG) {}
+
+	Bound analyze(Value *V) {
+		if (Instruction *I = dyn_cast<Instruction>(V))
+			return visit(I);
+		if (ConstantInt *CI = dyn_cast<ConstantInt>(V))
+			return Bound(ConstantRange(CI->getValue()));
+		if (isa<ConstantPointerNull>(V))
+			return Bound(ConstantRange(APInt::getNullValue(getBitWidth(V))));
+		return full(V);
+	}
+
+	// Fresh variables of ValueGen, constrained by intrange only.
+	Bound visitInstruction(Instruction &I) {
+		unsigned W = getBitWidth(&I);
+		ConstantRange CR(W, true);
+		MDNode *MD = I.getMetadata("intrange");
+		for (unsigned i = 0, n = MD ? MD->getNumOperands() : 0; i + 1 < n;
+		     i += 2) {
+			ConstantInt *Lo = dyn_cast<ConstantInt>(MD->getOperand(i));
+			ConstantInt *Hi = dyn_cast<ConstantInt>(MD->getOperand(i + 1));
+			if (!Lo || !Hi || Lo->getBitWidth() != W ||
+			    Lo->getValue() == Hi->getValue())
+				continue;
+			CR = CR.intersectWith(ConstantRange(Lo->getValue(), Hi->getValue()));
+		}
+		return Bound(CR);
+	}
+
+	Bound visitTruncInst(TruncInst &I) {
+		unsigned W = getBitWidth(&I);
+		const Bound &B = get(I.getOperand(0));
+		return Bound(B.Range.truncate(W), B.Zero.trunc(W), B.One.trunc(W));
+	}
+
+	Bound visitZExtInst(ZExtInst &I) {
+		unsigned W = getBitWidth(&I);
+		const Bound &B = get(I.getOperand(0));
+		APInt Zero = B.Zero.zext(W);
+		Zero |= APInt::getHighBitsSet(W, W - B.getBitWidth());
+		return Bound(B.Range.zeroExtend(W), Zero, B.One.zext(W));
+	}
+
+	Bound visitSExtInst(SExtInst &I) {
+		unsigned W = getBitWidth(&I);
+		const Bound &B = get(I.getOperand(0));
+		return Bound(B.Range.signExtend(W), B.Zero.sext(W), B.One.sext(W));
+	}
+
+	Bound visitBinaryOperator(BinaryOperator &I) {
+		const Bound &L = get(I.getOperand(0)), &R = get(I.getOperand(1));
+		unsigned W = L.getBitWidth();
+		ConstantRange CR(W, true);
+		APInt Zero(W, 0), One(W, 0);
+		// Shifts by a constant move known bits.
+		const APInt *Amt = R.Range.getSingleElement();
+		unsigned Shift = Amt && Amt->ult(W) ? Amt->getZExtValue() : W;
+		switch (I.getOpcode()) {
+		default: break;
+		case Instruction::Add:  CR = L.Range.add(R.Range); break;
+		case Instruction::Sub:  CR = L.Range.sub(R.Range); break;
+		case Instruction::Mul:  CR = L.Range.multiply(R.Range); break;
+		case Instruction::UDiv:
+			// The solver divides by zero as well.
+			if (!R.Range.contains(APInt::getNullValue(W)))
+				CR = L.Range.udiv(R.Range);
+			break;
+		case Instruction::URem: {
+			// At most the dividend, which is also the result of x % 0,
+			// and less than a nonzero divisor.
+			if (L.Range.isEmptySet() || R.Range.isEmptySet())
+				break;
+			APInt Max = L.Range.getUnsignedMax();
+			if (!R.Range.contains(APInt::getNullValue(W)))
+				Max = APIntOps::umin(Max, R.Range.getUnsignedMax() - 1);
+			if (!Max.isMaxValue())
+				CR = ConstantRange(APInt::getNullValue(W), Max + 1);
+			break;
+		}
+		case Instruction::Shl:
+			CR = L.Range.shl(R.Range);
+			if (Shift < W) {
+				Zero = L.Zero.shl(Shift) | APInt::getLowBitsSet(W, Shift);
+				One = L.One.shl(Shift);
+			}
+			break;
+		case Instruction::LShr:
+			CR = L.Range.lshr(R.Range);
+			if (Shift < W) {
+				Zero = L.Zero.lshr(Shift) | APInt::getHighBitsSet(W, Shift);
+				One = L.One.lshr(Shift);
+			}
+			break;
+		case Instruction::And:
+			CR = L.Range.binaryAnd(R.Range);
+			Zero = L.Zero | R.Zero;
+			One = L.One & R.One;
+			break;
+		case Instruction::Or:
+			CR = L.Range.binaryOr(R.Range);
+			Zero = L.Zero & R.Zero;
+			One = L.One | R.One;
+			break;
+		case Instruction::Xor:
+			Zero = (L.Zero & R.Zero) | (L.One & R.One);
+			One = (L.Zero & R.One) | (L.One & R.Zero);
+			break;
+		}
+		return Bound(CR, Zero, One);
+	}
+
+	Bound visitICmpInst(ICmpInst &I) {
+		const Bound &L = get(I.getOperand(0)), &R = get(I.getOperand(1));
+		if (never(I.getPredicate(), L, R))
+			return Bound(ConstantRange(APInt(1, 0)));
+		if (never(I.getInversePredicate(), L, R))
+			return Bound(ConstantRange(APInt(1, 1)));
+		return full(&I);
+	}
+
+	Bound visitSelectInst(SelectInst &I) {
+		const Bound &C = get(I.getCondition());
+		const Bound &T = get(I.getTrueValue());
+		const Bound &F = get(I.getFalseValue());
+		if (!!C.One)
+			return T;
+		if (!!C.Zero)
+			return F;
+		return Bound(T.Range.unionWith(F.Range), T.Zero & F.Zero,
+		             T.One & F.One);
+	}
+
+	Bound visitExtractValueInst(ExtractValueInst &I) {
+		IntrinsicInst *II = dyn_cast<IntrinsicInst>(I.getAggregateOperand());
+		if (!II || II->getCalledFunction()->getName().find(".with.overflow.")
+				== StringRef::npos || I.getNumIndices() != 1)
+			return full(&I);
+		const Bound &L = get(II->getArgOperand(0));
+		const Bound &R = get(II->getArgOperand(1));
+		Intrinsic::ID ID = II->getIntrinsicID();
+		if (I.getIndices()[0] == 1) {
+			if (mayOverflow(ID, L.Range, R.Range))
+				return full(&I);
+			return Bound(ConstantRange(APInt(1, 0)));
+		}
+		switch (ID) {
+		default: return full(&I);
+		case Intrinsic::sadd_with_overflow:
+		case Intrinsic::uadd_with_overflow:
+			return Bound(L.Range.add(R.Range));
+		case Intrinsic::ssub_with_overflow:
+		case Intrinsic::usub_with_overflow:
+			return Bound(L.Range.sub(R.Range));
+		case Intrinsic::smul_with_overflow:
+		case Intrinsic::umul_with_overflow:
+			return Bound(L.Range.multiply(R.Range));
+		}
+	}
+
+	Bound visitBitCastInst(BitCastInst &I) {
+		Value *V = I.getOperand(0);
+		if (!V->getType()->isIntegerTy() && !V->getType()->isPointerTy())
+			return full(&I);
+		return get(V);
+	}
+
+private:
+	RangeGen &RG;
+
+	const Bound &get(Value *V) {
+		return RG.get(V);
+	}
+
+	unsigned getBitWidth(Value *V) const {
+		Type *T = V->getType();
+		if (T->isPointerTy())
+			return TD.getPointerSizeInBits();
+		return TD.getTypeSizeInBits(T);
+	}
+
+	Bound full(Value *V) {
+		return Bound(ConstantRange(getBitWidth(V), true));
+	}
+};
+
+#undef TD
+
+} // anonymous namespace
+
+RangeGen::RangeGen(DataLayout &TD)
+	: TD(TD) {}
+
+const Bound &RangeGen::get(Value *V) {
+	// References to map entries stay valid as the visitor inserts more.
+	ValueBoundMap::iterator i = Cache.find(V);
+	if (i == Cache.end()) {
+		Bound B = BoundVisitor(*this).analyze(V);
+		i = Cache.insert(std::make_pair(V, B)).first;
+	}
+	return i->second;
+}
+
+bool RangeGen::isFalse(Value *V) {
+	const Bound &B = get(V);
+	return B.Zero[0] && !B.One[0];
+}
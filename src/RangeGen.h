@@ -0,0 +1,35 @@
+#pragma once
+
+#include <llvm/DataLayout.h>
+#include <llvm/ADT/APInt.h>
+#include <llvm/Support/ConstantRange.h>
+#include <map>
+
+// Intervals and known bits of the values ValueGen encodes, assuming
+// nothing about its fresh variables beyond their intrange metadata.
+// A condition that is false here is unsatisfiable for the solver too.
+class RangeGen {
+public:
+	struct Bound {
+		llvm::ConstantRange Range;
+		// known zero and one bits
+		llvm::APInt Zero, One;
+
+		explicit Bound(const llvm::ConstantRange &);
+		Bound(const llvm::ConstantRange &, const llvm::APInt &Zero_,
+		      const llvm::APInt &One_);
+		unsigned getBitWidth() const { return Range.getBitWidth(); }
+	};
+
+	llvm::DataLayout &TD;
+
+	typedef std::map<llvm::Value *, Bound> ValueBoundMap;
+	ValueBoundMap Cache;
+
+	RangeGen(llvm::DataLayout &);
+
+	const Bound &get(llvm::Value *);
+	// whether the i1 value V is false for any inputs
+	bool isFalse(llvm::Value *V);
+	void clear() { Cache.clear(); }
+};
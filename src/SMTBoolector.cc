@@ -14,6 +14,79 @@ extern "C" {
 
 using namespace llvm;
 
+namespace {
+
+class SMTBoolector : public SMTSolver {
+public:
+	SMTBoolector(bool modelgen);
+	~SMTBoolector();
+
+	static std::string version();
+
+	// Lingeling stays stopped once terminated.
+	bool resumable() const { return false; }
+	void eval(SMTModel, SMTExpr, llvm::APInt &);
+	void release(SMTModel);
+	void print(SMTExpr, llvm::raw_ostream &);
+	void incref(SMTExpr);
+	void decref(SMTExpr);
+	unsigned bvwidth(SMTExpr);
+
+protected:
+	void constrain(SMTExpr);
+	SMTStatus solve(SMTExpr, SMTModel *);
+	void interrupt();
+
+	SMTExpr mk_bvfalse();
+	SMTExpr mk_bvtrue();
+	SMTExpr mk_bvconst(const llvm::APInt &);
+	SMTExpr mk_bvvar(unsigned width, const char *name);
+	SMTExpr mk_ite(SMTExpr, SMTExpr, SMTExpr);
+	SMTExpr mk_eq(SMTExpr, SMTExpr);
+	SMTExpr mk_ne(SMTExpr, SMTExpr);
+	SMTExpr mk_bvslt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsle(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsgt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsge(SMTExpr, SMTExpr);
+	SMTExpr mk_bvult(SMTExpr, SMTExpr);
+	SMTExpr mk_bvule(SMTExpr, SMTExpr);
+	SMTExpr mk_bvugt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvuge(SMTExpr, SMTExpr);
+	SMTExpr mk_extract(unsigned high, unsigned low, SMTExpr);
+	SMTExpr mk_zero_extend(unsigned i, SMTExpr);
+	SMTExpr mk_sign_extend(unsigned i, SMTExpr);
+	SMTExpr mk_bvredand(SMTExpr);
+	SMTExpr mk_bvredor(SMTExpr);
+	SMTExpr mk_bvnot(SMTExpr);
+	SMTExpr mk_bvneg(SMTExpr);
+	SMTExpr mk_bvadd(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsub(SMTExpr, SMTExpr);
+	SMTExpr mk_bvmul(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsdiv(SMTExpr, SMTExpr);
+	SMTExpr mk_bvudiv(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsrem(SMTExpr, SMTExpr);
+	SMTExpr mk_bvurem(SMTExpr, SMTExpr);
+	SMTExpr mk_bvshl(SMTExpr, SMTExpr);
+	SMTExpr mk_bvlshr(SMTExpr, SMTExpr);
+	SMTExpr mk_bvashr(SMTExpr, SMTExpr);
+	SMTExpr mk_bvand(SMTExpr, SMTExpr);
+	SMTExpr mk_bvor(SMTExpr, SMTExpr);
+	SMTExpr mk_bvxor(SMTExpr, SMTExpr);
+	SMTExpr mk_bvneg_overflow(SMTExpr);
+	SMTExpr mk_bvsadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvuadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvssub_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvusub_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsmul_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvumul_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsdiv_overflow(SMTExpr, SMTExpr);
+
+protected:
+	SMTContext ctx_;
+};
+
+} // anonymous namespace
+
 #define ctx ((Btor *)ctx_)
 #define m   ((Btor *)m_)
 #define e   ((BtorNode *)e_)
@@ -30,23 +103,61 @@ namespace {
 
 static SMTWorkaround X;
 
-SMTSolver::SMTSolver(bool modelgen) {
+// Polled by Lingeling; see lib/boolector-term.patch.
+static int terminate(void *p) {
+	return ((SMTBoolector *)p)->interrupted();
+}
+
+SMTBoolector::SMTBoolector(bool modelgen) {
 	ctx_ = boolector_new();
 	if (modelgen)
 		boolector_enable_model_gen(ctx);
 	boolector_enable_inc_usage(ctx);
+	// Lingeling skips its clone and budget limit while a callback is
+	// set, so install it only if queries may be stopped.
+	if (stoppable())
+		boolector_set_term(ctx, terminate, this);
 }
 
-SMTSolver::~SMTSolver() {
+SMTBoolector::~SMTBoolector() {
+	clear_shapes();
 	assert(boolector_get_refs(ctx) == 0);
 	boolector_delete(ctx);
 }
 
-void SMTSolver::assume(SMTExpr e_) {
+static RegisterSMTBackend<SMTBoolector>
+Backend("boolector", "Boolector with Lingeling");
+
+// The versions bundled in lib/Makefile.am.
+std::string SMTBoolector::version() {
+	return "boolector-1.5.116-eeaf10b lingeling-al6-080d45d";
+}
+
+namespace {
+
+// Less rewriting leaves the SAT solver a different formula, which
+// makes a portfolio member unlike the default one.
+class SMTBoolectorRW1 : public SMTBoolector {
+public:
+	SMTBoolectorRW1(bool modelgen) : SMTBoolector(modelgen) {
+		boolector_set_rewrite_level(ctx, 1);
+	}
+
+	static std::string version() {
+		return SMTBoolector::version() + " rewrite-level-1";
+	}
+};
+
+} // anonymous namespace
+
+static RegisterSMTBackend<SMTBoolectorRW1>
+BackendRW1("boolector-rw1", "Boolector with rewrite level 1");
+
+void SMTBoolector::constrain(SMTExpr e_) {
 	boolector_assert(ctx, e);
 }
 
-SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
+SMTStatus SMTBoolector::solve(SMTExpr e_, SMTModel *m_) {
 	boolector_assume(ctx, e);
 	switch (boolector_sat(ctx)) {
 	default:              return SMT_UNDEF;
@@ -58,7 +169,10 @@ SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
 	return SMT_SAT;
 }
 
-void SMTSolver::eval(SMTModel m_, SMTExpr e_, APInt &v) {
+// The callback set up in the constructor picks up the flag.
+void SMTBoolector::interrupt() {}
+
+void SMTBoolector::eval(SMTModel m_, SMTExpr e_, APInt &v) {
 	char *s = boolector_bv_assignment(ctx, e);
 	std::string str(s);
 	boolector_free_bv_assignment(ctx, s);
@@ -66,14 +180,9 @@ void SMTSolver::eval(SMTModel m_, SMTExpr e_, APInt &v) {
 	v = APInt(bvwidth(e), str.c_str(), 2);
 }
 
-void SMTSolver::release(SMTModel m_) {}
-
-void SMTSolver::dump(SMTExpr e_) {
-	print(e, dbgs());
-	dbgs() << "\n";
-}
+void SMTBoolector::release(SMTModel m_) {}
 
-void SMTSolver::print(SMTExpr e_, raw_ostream &OS) {
+void SMTBoolector::print(SMTExpr e_, raw_ostream &OS) {
 	FILE *fp = tmpfile();
 	assert(fp && "tmpfile");
 	boolector_dump_smt(ctx, fp, e);
@@ -88,27 +197,27 @@ void SMTSolver::print(SMTExpr e_, raw_ostream &OS) {
 	fclose(fp);
 }
 
-void SMTSolver::incref(SMTExpr e_) {
+void SMTBoolector::incref(SMTExpr e_) {
 	boolector_copy(ctx, e);
 }
 
-void SMTSolver::decref(SMTExpr e_) {
+void SMTBoolector::decref(SMTExpr e_) {
 	boolector_release(ctx, e);
 }
 
-unsigned SMTSolver::bvwidth(SMTExpr e_) {
+unsigned SMTBoolector::bvwidth(SMTExpr e_) {
 	return boolector_get_width(ctx, e);
 }
 
-SMTExpr SMTSolver::bvfalse() {
+SMTExpr SMTBoolector::mk_bvfalse() {
 	return boolector_false(ctx);
 }
 
-SMTExpr SMTSolver::bvtrue() {
+SMTExpr SMTBoolector::mk_bvtrue() {
 	return boolector_true(ctx);
 }
 
-SMTExpr SMTSolver::bvconst(const APInt &Val) {
+SMTExpr SMTBoolector::mk_bvconst(const APInt &Val) {
 	unsigned intbits = sizeof(unsigned) * CHAR_BIT;
 	unsigned width = Val.getBitWidth();
 	if (width <= intbits)
@@ -121,107 +230,107 @@ SMTExpr SMTSolver::bvconst(const APInt &Val) {
 	return boolector_const(ctx, FullStr.c_str());
 }
 
-SMTExpr SMTSolver::bvvar(unsigned width, const char *name) {
+SMTExpr SMTBoolector::mk_bvvar(unsigned width, const char *name) {
 	return boolector_var(ctx, width, name);
 }
 
-SMTExpr SMTSolver::ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_cond(ctx, e, lhs, rhs);
 }
 
-SMTExpr SMTSolver::eq(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_eq(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_eq(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::ne(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_ne(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ne(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvslt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvslt(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_slt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsle(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvsle(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_slte(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_sgt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvsge(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_sgte(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvult(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvult(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ult(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvule(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvule(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ulte(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvugt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvugt(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ugt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvuge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvuge(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ugte(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::extract(unsigned high, unsigned low, SMTExpr e_) {
+SMTExpr SMTBoolector::mk_extract(unsigned high, unsigned low, SMTExpr e_) {
 	return boolector_slice(ctx, e, high, low);
 }
 
-SMTExpr SMTSolver::zero_extend(unsigned i, SMTExpr e_) {
+SMTExpr SMTBoolector::mk_zero_extend(unsigned i, SMTExpr e_) {
 	return boolector_uext(ctx, e, i);
 }
 
-SMTExpr SMTSolver::sign_extend(unsigned i, SMTExpr e_) {
+SMTExpr SMTBoolector::mk_sign_extend(unsigned i, SMTExpr e_) {
 	return boolector_sext(ctx, e, i);
 }
 
-SMTExpr SMTSolver::bvredand(SMTExpr e_) {
+SMTExpr SMTBoolector::mk_bvredand(SMTExpr e_) {
 	return boolector_redand(ctx, e);
 }
 
-SMTExpr SMTSolver::bvredor(SMTExpr e_) {
+SMTExpr SMTBoolector::mk_bvredor(SMTExpr e_) {
 	return boolector_redor(ctx, e);
 }
 
-SMTExpr SMTSolver::bvnot(SMTExpr e_) {
+SMTExpr SMTBoolector::mk_bvnot(SMTExpr e_) {
 	return boolector_not(ctx, e);
 }
 
-SMTExpr SMTSolver::bvneg(SMTExpr e_) {
+SMTExpr SMTBoolector::mk_bvneg(SMTExpr e_) {
 	return boolector_neg(ctx, e);
 }
 
-SMTExpr SMTSolver::bvadd(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvadd(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_add(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsub(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvsub(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_sub(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvmul(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvmul(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_mul(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_sdiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_udiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_srem(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvurem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvurem(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_urem(ctx, lhs, rhs);
 }
 
@@ -248,61 +357,61 @@ static inline SMTExpr shift(Btor *btor,  BtorNode *e0,  BtorNode *e1) {
 	return result;
 }
 
-SMTExpr SMTSolver::bvshl(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvshl(SMTExpr lhs_, SMTExpr rhs_) {
 	return shift<boolector_sll>(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
 	return shift<boolector_srl>(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvashr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvashr(SMTExpr lhs_, SMTExpr rhs_) {
 	return shift<boolector_sra>(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvand(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvand(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_and(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvor(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_or(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvxor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvxor(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_xor(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvneg_overflow(SMTExpr e_) {
+SMTExpr SMTBoolector::mk_bvneg_overflow(SMTExpr e_) {
 	SMTExpr zero = boolector_zero(ctx, bvwidth(e));
-	SMTExpr tmp = bvssub_overflow(zero, e);
+	SMTExpr tmp = mk_bvssub_overflow(zero, e);
 	decref(zero);
 	return tmp;
 }
 
-SMTExpr SMTSolver::bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_saddo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_uaddo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ssubo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_usubo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_smulo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_umulo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTBoolector::mk_bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_sdivo(ctx, lhs, rhs);
 }
@@ -0,0 +1,349 @@
+#include "SMTPortfolio.h"
+#include <llvm/ADT/APInt.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <sys/time.h>
+#include <err.h>
+#include <errno.h>
+
+using namespace llvm;
+
+#define n  ((Node *)n_)
+#define E(x) (((Node *)(x))->e[i])
+
+// Builders of expressions from other expressions only.
+#define OPERATIONS \
+	BINARY(eq) BINARY(ne) \
+	BINARY(bvslt) BINARY(bvsle) BINARY(bvsgt) BINARY(bvsge) \
+	BINARY(bvult) BINARY(bvule) BINARY(bvugt) BINARY(bvuge) \
+	UNARY(bvredand) UNARY(bvredor) UNARY(bvnot) UNARY(bvneg) \
+	BINARY(bvadd) BINARY(bvsub) BINARY(bvmul) \
+	BINARY(bvsdiv) BINARY(bvudiv) BINARY(bvsrem) BINARY(bvurem) \
+	BINARY(bvshl) BINARY(bvlshr) BINARY(bvashr) \
+	BINARY(bvand) BINARY(bvor) BINARY(bvxor) \
+	UNARY(bvneg_overflow) \
+	BINARY(bvsadd_overflow) BINARY(bvuadd_overflow) \
+	BINARY(bvssub_overflow) BINARY(bvusub_overflow) \
+	BINARY(bvsmul_overflow) BINARY(bvumul_overflow) \
+	BINARY(bvsdiv_overflow)
+
+#define UNARY(name) OP_##name,
+#define BINARY(name) OP_##name,
+enum {
+	OP_bvfalse, OP_bvtrue, OP_bvconst, OP_bvvar, OP_ite,
+	OP_extract, OP_zero_extend, OP_sign_extend,
+	OPERATIONS
+};
+#undef UNARY
+#undef BINARY
+
+SMTPortfolio::SMTPortfolio(const std::vector<SMTBackend *> &backends,
+                           unsigned delay, bool modelgen)
+	: delay_(delay), modelgen_(modelgen), query_(NULL), wantmodel_(false),
+	  stopping_(false), winner_(-1) {
+	pthread_mutex_init(&lock_, NULL);
+	pthread_cond_init(&cond_, NULL);
+	for (unsigned i = 0; i != backends.size(); ++i) {
+		Member M;
+		M.owner = this;
+		M.backend = backends[i];
+		M.solver = backends[i]->create(modelgen);
+		M.started = M.done = false;
+		M.status = SMT_UNDEF;
+		M.model = NULL;
+		members_.push_back(M);
+	}
+}
+
+SMTPortfolio::~SMTPortfolio() {
+	clear_shapes();
+	for (unsigned i = 0; i != assumed_.size(); ++i)
+		decref(assumed_[i]);
+	for (unsigned i = 0; i != members_.size(); ++i)
+		delete members_[i].solver;
+	pthread_cond_destroy(&cond_);
+	pthread_mutex_destroy(&lock_);
+}
+
+void SMTPortfolio::constrain(SMTExpr n_) {
+	incref(n);
+	assumed_.push_back(n);
+	for (unsigned i = 0; i != members_.size(); ++i)
+		members_[i].solver->assume(n->e[i]);
+}
+
+SMTStatus SMTPortfolio::solve(SMTExpr n_, SMTModel *m_) {
+	const unsigned first = 0;
+	pthread_mutex_lock(&lock_);
+	query_ = n_;
+	wantmodel_ = m_;
+	stopping_ = false;
+	winner_ = -1;
+	for (unsigned i = 0; i != members_.size(); ++i) {
+		Member &M = members_[i];
+		M.started = M.done = false;
+		M.status = SMT_UNDEF;
+		M.model = NULL;
+		M.solver->interrupted_ = false;
+	}
+	start(first);
+	// Give the first member a head start.
+	if (delay_) {
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		uint64_t us = (uint64_t)now.tv_sec * 1000000 + now.tv_usec
+			+ (uint64_t)delay_ * 1000;
+		struct timespec deadline;
+		deadline.tv_sec = us / 1000000;
+		deadline.tv_nsec = us % 1000000 * 1000;
+		while (!members_[first].done && !stopping_)
+			if (pthread_cond_timedwait(&cond_, &lock_, &deadline) == ETIMEDOUT)
+				break;
+	}
+	if (winner_ < 0 && !stopping_)
+		for (unsigned i = first + 1; i != members_.size(); ++i)
+			start(i);
+	while (winner_ < 0 && !finished())
+		pthread_cond_wait(&cond_, &lock_);
+	stopOthers(winner_);
+	pthread_mutex_unlock(&lock_);
+
+	SMTStatus res = SMT_UNDEF;
+	for (unsigned i = 0; i != members_.size(); ++i) {
+		Member &M = members_[i];
+		if (!M.started)
+			continue;
+		pthread_join(M.thread, NULL);
+		if ((int)i == winner_) {
+			res = M.status;
+			if (M.model) {
+				Model *m = new Model;
+				m->member = i;
+				m->m = M.model;
+				*m_ = m;
+			}
+		} else if (M.model) {
+			M.solver->release(M.model);
+		}
+		if (M.solver->interrupted() && !M.solver->resumable())
+			renew(i);
+	}
+	return res;
+}
+
+// Whether all members started have answered.
+bool SMTPortfolio::finished() {
+	for (unsigned i = 0; i != members_.size(); ++i)
+		if (members_[i].started && !members_[i].done)
+			return false;
+	return true;
+}
+
+void SMTPortfolio::start(unsigned i) {
+	Member &M = members_[i];
+	if (pthread_create(&M.thread, NULL, run, &M))
+		err(1, "pthread_create");
+	M.started = true;
+}
+
+// Stop all members but the winner that are still running.
+void SMTPortfolio::stopOthers(int winner) {
+	for (unsigned i = 0; i != members_.size(); ++i) {
+		Member &M = members_[i];
+		if (M.started && !M.done && (int)i != winner)
+			M.solver->stop();
+	}
+}
+
+void *SMTPortfolio::run(void *p) {
+	Member &M = *(Member *)p;
+	SMTPortfolio &P = *M.owner;
+	unsigned i = &M - &P.members_[0];
+	SMTModel m = NULL;
+	SMTStatus status = M.solver->solve(E(P.query_), P.wantmodel_ ? &m : NULL);
+	pthread_mutex_lock(&P.lock_);
+	M.status = status;
+	M.model = m;
+	M.done = true;
+	if (P.winner_ < 0 && (status == SMT_SAT || status == SMT_UNSAT))
+		P.winner_ = i;
+	pthread_cond_signal(&P.cond_);
+	pthread_mutex_unlock(&P.lock_);
+	return NULL;
+}
+
+// Called by the watchdog from another thread.
+void SMTPortfolio::interrupt() {
+	pthread_mutex_lock(&lock_);
+	stopping_ = true;
+	stopOthers(-1);
+	pthread_cond_signal(&cond_);
+	pthread_mutex_unlock(&lock_);
+}
+
+void SMTPortfolio::eval(SMTModel m_, SMTExpr n_, APInt &Res) {
+	Model *m = (Model *)m_;
+	unsigned i = m->member;
+	members_[i].solver->eval(m->m, n->e[i], Res);
+}
+
+void SMTPortfolio::release(SMTModel m_) {
+	Model *m = (Model *)m_;
+	members_[m->member].solver->release(m->m);
+	delete m;
+}
+
+void SMTPortfolio::print(SMTExpr n_, raw_ostream &OS) {
+	members_[0].solver->print(n->e[0], OS);
+}
+
+void SMTPortfolio::incref(SMTExpr n_) {
+	++n->refs;
+}
+
+void SMTPortfolio::decref(SMTExpr n_) {
+	if (--n->refs)
+		return;
+	for (unsigned i = 0; i != members_.size(); ++i)
+		members_[i].solver->decref(n->e[i]);
+	nodes_.erase(n);
+	for (unsigned k = 0; k != 3 && n->ops[k]; ++k)
+		decref(n->ops[k]);
+	delete n;
+}
+
+unsigned SMTPortfolio::bvwidth(SMTExpr n_) {
+	return members_[0].solver->bvwidth(n->e[0]);
+}
+
+SMTPortfolio::Node *SMTPortfolio::node(unsigned op, SMTExpr a, SMTExpr b,
+                                        SMTExpr c) {
+	Node *N = new Node;
+	N->refs = 1;
+	N->op = op;
+	N->ops[0] = (Node *)a;
+	N->ops[1] = (Node *)b;
+	N->ops[2] = (Node *)c;
+	for (unsigned k = 0; k != 3 && N->ops[k]; ++k)
+		incref(N->ops[k]);
+	N->imm[0] = N->imm[1] = 0;
+	return N;
+}
+
+// Build the expression in each member.
+SMTExpr SMTPortfolio::build(Node *N) {
+	for (unsigned i = 0; i != members_.size(); ++i)
+		N->e.push_back(make(i, N));
+	nodes_.insert(N);
+	return N;
+}
+
+SMTExpr SMTPortfolio::make(unsigned i, Node *N) {
+	SMTSolver *S = members_[i].solver;
+	Node **ops = N->ops;
+	switch (N->op) {
+	default: llvm_unreachable("unknown operation");
+	case OP_bvfalse:      return S->mk_bvfalse();
+	case OP_bvtrue:       return S->mk_bvtrue();
+	case OP_bvconst:      return S->mk_bvconst(N->val);
+	case OP_bvvar:        return S->mk_bvvar(N->imm[0], N->name.c_str());
+	case OP_ite:          return S->mk_ite(E(ops[0]), E(ops[1]), E(ops[2]));
+	case OP_extract:
+		return S->mk_extract(N->imm[0], N->imm[1], E(ops[0]));
+	case OP_zero_extend:  return S->mk_zero_extend(N->imm[0], E(ops[0]));
+	case OP_sign_extend:  return S->mk_sign_extend(N->imm[0], E(ops[0]));
+#define UNARY(name) \
+	case OP_##name: return S->mk_##name(E(ops[0]));
+#define BINARY(name) \
+	case OP_##name: return S->mk_##name(E(ops[0]), E(ops[1]));
+	OPERATIONS
+#undef UNARY
+#undef BINARY
+	}
+}
+
+// Build the expression in member i again, operands first.
+void SMTPortfolio::rebuild(unsigned i, Node *N) {
+	if (N->e[i])
+		return;
+	for (unsigned k = 0; k != 3 && N->ops[k]; ++k)
+		rebuild(i, N->ops[k]);
+	N->e[i] = make(i, N);
+}
+
+// Replace member i, which cannot answer after being stopped, with a new
+// solver of its backend holding the same expressions and assumptions.
+void SMTPortfolio::renew(unsigned i) {
+	Member &M = members_[i];
+	typedef DenseSet<Node *>::iterator iterator;
+	// Release expressions before their solver.
+	for (iterator it = nodes_.begin(), ie = nodes_.end(); it != ie; ++it) {
+		M.solver->decref((*it)->e[i]);
+		(*it)->e[i] = NULL;
+	}
+	delete M.solver;
+	M.solver = M.backend->create(modelgen_);
+	for (iterator it = nodes_.begin(), ie = nodes_.end(); it != ie; ++it)
+		rebuild(i, *it);
+	for (unsigned k = 0; k != assumed_.size(); ++k)
+		M.solver->assume(assumed_[k]->e[i]);
+}
+
+SMTExpr SMTPortfolio::mk_bvfalse() {
+	return build(node(OP_bvfalse));
+}
+
+SMTExpr SMTPortfolio::mk_bvtrue() {
+	return build(node(OP_bvtrue));
+}
+
+SMTExpr SMTPortfolio::mk_bvconst(const APInt &Val) {
+	Node *N = node(OP_bvconst);
+	N->val = Val;
+	return build(N);
+}
+
+SMTExpr SMTPortfolio::mk_bvvar(unsigned width, const char *name) {
+	Node *N = node(OP_bvvar);
+	N->imm[0] = width;
+	N->name = name;
+	return build(N);
+}
+
+SMTExpr SMTPortfolio::mk_ite(SMTExpr c, SMTExpr a, SMTExpr b) {
+	return build(node(OP_ite, c, a, b));
+}
+
+SMTExpr SMTPortfolio::mk_extract(unsigned high, unsigned low, SMTExpr a) {
+	Node *N = node(OP_extract, a);
+	N->imm[0] = high;
+	N->imm[1] = low;
+	return build(N);
+}
+
+SMTExpr SMTPortfolio::mk_zero_extend(unsigned k, SMTExpr a) {
+	Node *N = node(OP_zero_extend, a);
+	N->imm[0] = k;
+	return build(N);
+}
+
+SMTExpr SMTPortfolio::mk_sign_extend(unsigned k, SMTExpr a) {
+	Node *N = node(OP_sign_extend, a);
+	N->imm[0] = k;
+	return build(N);
+}
+
+#define UNARY(name) \
+	SMTExpr SMTPortfolio::mk_##name(SMTExpr a) { \
+		return build(node(OP_##name, a)); \
+	}
+
+#define BINARY(name) \
+	SMTExpr SMTPortfolio::mk_##name(SMTExpr a, SMTExpr b) { \
+		return build(node(OP_##name, a, b)); \
+	}
+
+OPERATIONS
+
+#undef UNARY
+#undef BINARY
+#undef OPERATIONS
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include "SMTSolver.h"
+
+// Solvers of several backends that race on each query, selected with
+// -smt-portfolio.  Expressions are built in every member; a query goes
+// to all of them, and the first SAT or UNSAT answer stops the others.
+// A stopped member that cannot resume is replaced before the next query
+// by a new solver of its backend, into which the live expressions and
+// the assumptions are built again.
+class SMTPortfolio : public SMTSolver {
+public:
+	// With a delay, the first member runs alone for that many
+	// milliseconds before the others join.
+	SMTPortfolio(const std::vector<SMTBackend *> &, unsigned delay,
+	             bool modelgen);
+	~SMTPortfolio();
+
+	bool resumable() const { return true; }
+	void eval(SMTModel, SMTExpr, llvm::APInt &);
+	void release(SMTModel);
+	void print(SMTExpr, llvm::raw_ostream &);
+	void incref(SMTExpr);
+	void decref(SMTExpr);
+	unsigned bvwidth(SMTExpr);
+
+protected:
+	void constrain(SMTExpr);
+	SMTStatus solve(SMTExpr, SMTModel *);
+	void interrupt();
+
+	SMTExpr mk_bvfalse();
+	SMTExpr mk_bvtrue();
+	SMTExpr mk_bvconst(const llvm::APInt &);
+	SMTExpr mk_bvvar(unsigned width, const char *name);
+	SMTExpr mk_ite(SMTExpr, SMTExpr, SMTExpr);
+	SMTExpr mk_eq(SMTExpr, SMTExpr);
+	SMTExpr mk_ne(SMTExpr, SMTExpr);
+	SMTExpr mk_bvslt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsle(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsgt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsge(SMTExpr, SMTExpr);
+	SMTExpr mk_bvult(SMTExpr, SMTExpr);
+	SMTExpr mk_bvule(SMTExpr, SMTExpr);
+	SMTExpr mk_bvugt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvuge(SMTExpr, SMTExpr);
+	SMTExpr mk_extract(unsigned high, unsigned low, SMTExpr);
+	SMTExpr mk_zero_extend(unsigned i, SMTExpr);
+	SMTExpr mk_sign_extend(unsigned i, SMTExpr);
+	SMTExpr mk_bvredand(SMTExpr);
+	SMTExpr mk_bvredor(SMTExpr);
+	SMTExpr mk_bvnot(SMTExpr);
+	SMTExpr mk_bvneg(SMTExpr);
+	SMTExpr mk_bvadd(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsub(SMTExpr, SMTExpr);
+	SMTExpr mk_bvmul(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsdiv(SMTExpr, SMTExpr);
+	SMTExpr mk_bvudiv(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsrem(SMTExpr, SMTExpr);
+	SMTExpr mk_bvurem(SMTExpr, SMTExpr);
+	SMTExpr mk_bvshl(SMTExpr, SMTExpr);
+	SMTExpr mk_bvlshr(SMTExpr, SMTExpr);
+	SMTExpr mk_bvashr(SMTExpr, SMTExpr);
+	SMTExpr mk_bvand(SMTExpr, SMTExpr);
+	SMTExpr mk_bvor(SMTExpr, SMTExpr);
+	SMTExpr mk_bvxor(SMTExpr, SMTExpr);
+	SMTExpr mk_bvneg_overflow(SMTExpr);
+	SMTExpr mk_bvsadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvuadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvssub_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvusub_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsmul_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvumul_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsdiv_overflow(SMTExpr, SMTExpr);
+
+private:
+	// An expression of each member, and how it was built, so that it
+	// can be built again in a new member.  A node holds references to
+	// its operands.
+	struct Node {
+		unsigned refs;
+		llvm::SmallVector<SMTExpr, 4> e;
+		unsigned op;
+		Node *ops[3];
+		unsigned imm[2];
+		llvm::APInt val;
+		std::string name;
+	};
+
+	// A model of the member that answered.
+	struct Model {
+		unsigned member;
+		SMTModel m;
+	};
+
+	struct Member {
+		SMTPortfolio *owner;
+		SMTBackend *backend;
+		SMTSolver *solver;
+		// State of the current query.
+		bool started;
+		bool done;
+		SMTStatus status;
+		SMTModel model;
+		pthread_t thread;
+	};
+
+	std::vector<Member> members_;
+	unsigned delay_;
+	bool modelgen_;
+	// Live nodes, and assumptions in order.
+	llvm::DenseSet<Node *> nodes_;
+	std::vector<Node *> assumed_;
+
+	// Guards the query state, which member threads and stop() update.
+	pthread_mutex_t lock_;
+	pthread_cond_t cond_;
+	SMTExpr query_;
+	bool wantmodel_;
+	bool stopping_;
+	int winner_;
+
+	bool finished();
+	void start(unsigned);
+	void stopOthers(int);
+	static void *run(void *);
+
+	Node *node(unsigned op, SMTExpr = 0, SMTExpr = 0, SMTExpr = 0);
+	SMTExpr build(Node *);
+	SMTExpr make(unsigned member, Node *);
+	void rebuild(unsigned member, Node *);
+	void renew(unsigned member);
+};
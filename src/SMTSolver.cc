@@ -1,21 +1,128 @@
+#include "SMTSolver.h"
+#include "SMTPortfolio.h"
+#include <llvm/ADT/APInt.h>
 #include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Debug.h>
+#include <llvm/Support/raw_ostream.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 using namespace llvm;
 
+static cl::opt<std::string>
+SMTBackendOpt("smt-backend",
+              cl::desc("Specify the SMT solver backend"),
+              cl::value_desc("name"), cl::init("boolector"));
+
+static cl::list<std::string>
+SMTPortfolioOpt("smt-portfolio", cl::CommaSeparated,
+                cl::desc("Race these SMT backends on each query"),
+                cl::value_desc("name,name,..."));
+
+static cl::opt<unsigned>
+SMTPortfolioDelayOpt("smt-portfolio-delay",
+                     cl::desc("Start the other backends of the portfolio "
+                              "once the first has run this long"),
+                     cl::value_desc("milliseconds"));
+
 static cl::opt<unsigned>
 SMTTimeoutOpt("smt-timeout",
               cl::desc("Specify a timeout for SMT solver"),
               cl::value_desc("milliseconds"));
 
+static cl::opt<bool>
+SMTForkOpt("smt-fork",
+           cl::desc("Run each SMT query in a child process, "
+                    "isolating solver crashes"));
+
+static cl::opt<std::string>
+SMTCacheOpt("smt-cache",
+            cl::desc("Cache SMT results in a file shared by processes"),
+            cl::value_desc("filename"));
+
+SMTBackend *SMTBackend::list;
+
+SMTBackend::SMTBackend(const char *name, const char *desc, CreateFn create,
+                       VersionFn version)
+	: name(name), desc(desc), create(create), version(version), next(list) {
+	list = this;
+}
+
+SMTBackend *SMTBackend::lookup(const std::string &name) {
+	for (SMTBackend *b = list; b; b = b->next)
+		if (name == b->name)
+			return b;
+	return NULL;
+}
+
+SMTBackend &SMTBackend::find(const std::string &name) {
+	if (SMTBackend *b = lookup(name))
+		return *b;
+	errs() << "unknown SMT backend '" << name << "'; available:";
+	for (SMTBackend *b = list; b; b = b->next)
+		errs() << ' ' << b->name;
+	errs() << "\n";
+	exit(1);
+}
+
+SMTBackend &SMTBackend::get() {
+	static SMTBackend *backend;
+	if (backend)
+		return *backend;
+	// Without -smt-backend, fall back to any backend built in.
+	if (list && !SMTBackendOpt.getNumOccurrences() && !lookup(SMTBackendOpt))
+		backend = list;
+	else
+		backend = &find(SMTBackendOpt);
+	return *backend;
+}
+
+// Backends of -smt-portfolio, if any.
+static const std::vector<SMTBackend *> &getPortfolio() {
+	static std::vector<SMTBackend *> backends;
+	if (backends.empty())
+		for (unsigned i = 0; i != SMTPortfolioOpt.size(); ++i)
+			backends.push_back(&SMTBackend::find(SMTPortfolioOpt[i]));
+	return backends;
+}
+
+SMTSolver *SMTSolver::create(bool modelgen) {
+	const std::vector<SMTBackend *> &backends = getPortfolio();
+	if (!backends.empty())
+		return new SMTPortfolio(backends, SMTPortfolioDelayOpt, modelgen);
+	return SMTBackend::get().create(modelgen);
+}
+
+std::string SMTSolver::version() {
+	const std::vector<SMTBackend *> &backends = getPortfolio();
+	if (backends.empty())
+		return SMTBackend::get().version();
+	std::string s = "portfolio";
+	for (unsigned i = 0; i != backends.size(); ++i)
+		s += " " + backends[i]->version();
+	return s;
+}
+
+void SMTSolver::dump(SMTExpr e) {
+	print(e, dbgs());
+	dbgs() << "\n";
+}
+
 static pid_t pid;
 
 int SMTFork()
 {
-	if (!SMTTimeoutOpt)
+	if (!SMTTimeoutOpt || !SMTForkOpt)
 		return 0;
 	pid = fork();
 	if (pid < 0)
@@ -31,7 +138,7 @@ int SMTFork()
 
 void SMTJoin(int *status)
 {
-	if (!SMTTimeoutOpt)
+	if (!SMTTimeoutOpt || !SMTForkOpt)
 		return;
 	// Child process.
 	if (pid == 0)
@@ -39,7 +146,515 @@ void SMTJoin(int *status)
 	// Parent process.
 	waitpid(pid, status, 0);
 	if (WIFEXITED(*status))
-		*status = WEXITSTATUS(*status);
+		*status = (signed char)WEXITSTATUS(*status);
+	else if (WIFSIGNALED(*status) && WTERMSIG(*status) == SIGVTALRM)
+		*status = SMT_TIMEOUT;
 	else
-		*status = -1;
+		// Crashed; not a result worth caching.
+		*status = SMT_UNDEF;
+}
+
+namespace {
+
+// Stop queries that run past their deadline.  One thread serves all
+// solvers of the process; it is started by the first query.
+class SMTWatchdog {
+public:
+	SMTWatchdog() : started(false), solver(NULL) {
+		pthread_mutex_init(&lock, NULL);
+		pthread_cond_init(&cond, NULL);
+	}
+
+	void arm(SMTSolver *s, unsigned ms) {
+		pthread_mutex_lock(&lock);
+		if (!started) {
+			pthread_t t;
+			if (pthread_create(&t, NULL, run, this))
+				err(1, "pthread_create");
+			pthread_detach(t);
+			started = true;
+		}
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		uint64_t us = (uint64_t)now.tv_sec * 1000000 + now.tv_usec
+			+ (uint64_t)ms * 1000;
+		deadline.tv_sec = us / 1000000;
+		deadline.tv_nsec = us % 1000000 * 1000;
+		solver = s;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&lock);
+	}
+
+	// Once this returns, the solver is no longer stopped.
+	void disarm() {
+		pthread_mutex_lock(&lock);
+		solver = NULL;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&lock);
+	}
+
+private:
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool started;
+	SMTSolver *solver;
+	struct timespec deadline;
+
+	static void *run(void *p) {
+		((SMTWatchdog *)p)->loop();
+		return NULL;
+	}
+
+	void loop() {
+		pthread_mutex_lock(&lock);
+		for (;;) {
+			if (!solver) {
+				pthread_cond_wait(&cond, &lock);
+				continue;
+			}
+			if (pthread_cond_timedwait(&cond, &lock, &deadline) != ETIMEDOUT)
+				continue;
+			// The query may have been replaced meanwhile.
+			struct timeval now;
+			gettimeofday(&now, NULL);
+			if (!solver || now.tv_sec < deadline.tv_sec ||
+			    (now.tv_sec == deadline.tv_sec &&
+			     now.tv_usec * 1000 < deadline.tv_nsec))
+				continue;
+			solver->stop();
+			solver = NULL;
+		}
+	}
+};
+
+} // anonymous namespace
+
+static SMTWatchdog Watchdog;
+
+SMTStatus SMTSolver::query(SMTExpr e, SMTModel *m) {
+	interrupted_ = false;
+	if (!SMTTimeoutOpt || SMTForkOpt)
+		return solve(e, m);
+	Watchdog.arm(this, SMTTimeoutOpt);
+	SMTStatus res = solve(e, m);
+	Watchdog.disarm();
+	if (interrupted_ && res != SMT_SAT && res != SMT_UNSAT)
+		return SMT_TIMEOUT;
+	return res;
+}
+
+bool SMTSolver::stoppable() {
+	return (SMTTimeoutOpt && !SMTForkOpt) || !getPortfolio().empty();
+}
+
+void SMTSolver::stop() {
+	interrupted_ = true;
+	interrupt();
+}
+
+static uint64_t mix(uint64_t h, uint64_t v) {
+	h ^= v;
+	h *= 0x9e3779b97f4a7c15ULL;
+	return h ^ (h >> 29);
+}
+
+namespace {
+
+// The cache file has a header of a magic string, the format version and
+// a hash of the backend version, followed by fixed-size records.  Each
+// record is appended by a single write under an exclusive lock, so that
+// readers holding a shared lock see whole records only.
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t pad;
+	uint64_t backend;
+};
+
+// A timeout is measured in CPU time if forked, see SMTFork.
+struct CacheRecord {
+	uint64_t key;
+	uint64_t check;
+	int32_t status;
+	uint32_t timeout;
+	uint32_t forked;
+	uint32_t pad;
+};
+
+class SMTCache {
+public:
+	SMTCache() : fd(-1), offset(0) {
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "KINTSMT", 8);
+		header.version = 1;
+		std::string v = SMTSolver::version();
+		uint64_t h = 0;
+		for (size_t i = 0; i != v.size(); ++i)
+			h = mix(h, (unsigned char)v[i]);
+		header.backend = h;
+	}
+
+	~SMTCache() {
+		if (fd >= 0)
+			close(fd);
+	}
+
+	// Discard the file if it belongs to another backend.
+	bool open(const char *path) {
+		fd = ::open(path, O_RDWR | O_CREAT | O_APPEND, 0666);
+		if (fd < 0)
+			return false;
+		flock(fd, LOCK_EX);
+		if (!valid()) {
+			if (ftruncate(fd, 0) ||
+			    pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+				flock(fd, LOCK_UN);
+				return false;
+			}
+		}
+		flock(fd, LOCK_UN);
+		offset = sizeof(header);
+		return true;
+	}
+
+	bool lookup(uint64_t key, uint64_t check, int *status) {
+		if (find(key, check, status))
+			return true;
+		// Pick up results of other processes.
+		refresh();
+		return find(key, check, status);
+	}
+
+	void insert(uint64_t key, uint64_t check, int status) {
+		CacheRecord r = { key, check, status, SMTTimeoutOpt, SMTForkOpt, 0 };
+		add(r);
+		flock(fd, LOCK_EX);
+		// Another backend may have taken over the file.
+		if (valid() && write(fd, &r, sizeof(r)) != sizeof(r))
+			warn("smt-cache");
+		flock(fd, LOCK_UN);
+	}
+
+private:
+	int fd;
+	off_t offset;
+	CacheHeader header;
+	DenseMap<uint64_t, CacheRecord> results;
+
+	bool valid() {
+		CacheHeader h;
+		return pread(fd, &h, sizeof(h), 0) == sizeof(h) &&
+		       !memcmp(&h, &header, sizeof(h));
+	}
+
+	// Keep definite results over timeouts, and longer timeouts.  Skip
+	// timeouts measured by the other clock, and on a key collision,
+	// keep the later formula.
+	void add(const CacheRecord &r) {
+		if (r.status != SMT_SAT && r.status != SMT_UNSAT &&
+		    r.status != SMT_TIMEOUT)
+			return;
+		if (r.status == SMT_TIMEOUT && r.forked != (uint32_t)SMTForkOpt)
+			return;
+		std::pair<DenseMap<uint64_t, CacheRecord>::iterator, bool> i =
+			results.insert(std::make_pair(r.key, r));
+		CacheRecord &old = i.first->second;
+		if (i.second)
+			return;
+		if (old.check != r.check) {
+			old = r;
+			return;
+		}
+		if (old.status != SMT_TIMEOUT)
+			return;
+		if (r.status != SMT_TIMEOUT || r.timeout > old.timeout)
+			old = r;
+	}
+
+	bool find(uint64_t key, uint64_t check, int *status) {
+		DenseMap<uint64_t, CacheRecord>::iterator i = results.find(key);
+		if (i == results.end())
+			return false;
+		const CacheRecord &r = i->second;
+		if (r.check != check)
+			return false;
+		// A timeout says nothing about a longer or unlimited one.
+		if (r.status == SMT_TIMEOUT &&
+		    (!SMTTimeoutOpt || r.timeout < SMTTimeoutOpt))
+			return false;
+		*status = r.status;
+		return true;
+	}
+
+	void refresh() {
+		flock(fd, LOCK_SH);
+		struct stat st;
+		if (fstat(fd, &st) == 0 && valid()) {
+			// The file was discarded and started over.
+			if (st.st_size < offset) {
+				results.clear();
+				offset = sizeof(header);
+			}
+			CacheRecord buf[256];
+			for (;;) {
+				ssize_t n = pread(fd, buf, sizeof(buf), offset);
+				if (n < (ssize_t)sizeof(CacheRecord))
+					break;
+				size_t k = n / sizeof(CacheRecord);
+				for (size_t i = 0; i != k; ++i)
+					add(buf[i]);
+				offset += k * sizeof(CacheRecord);
+			}
+		}
+		flock(fd, LOCK_UN);
+	}
+};
+
+} // anonymous namespace
+
+static SMTCache *getCache() {
+	static SMTCache *cache;
+	static bool opened;
+	if (opened || SMTCacheOpt.empty())
+		return cache;
+	opened = true;
+	cache = new SMTCache;
+	if (!cache->open(SMTCacheOpt.c_str())) {
+		errs() << "warning: cannot open SMT cache " << SMTCacheOpt << "\n";
+		delete cache;
+		cache = NULL;
+	}
+	return cache;
+}
+
+bool SMTCacheLookup(uint64_t key, uint64_t check, int *status) {
+	SMTCache *cache = getCache();
+	return key && cache && cache->lookup(key, check, status);
+}
+
+void SMTCacheInsert(uint64_t key, uint64_t check, int status) {
+	if (SMTCache *cache = getCache())
+		if (key)
+			cache->insert(key, check, status);
+}
+
+// Expression shapes, recorded only with -smt-cache.
+
+enum {
+	OP_FALSE = 1, OP_TRUE, OP_CONST, OP_VAR, OP_ITE, OP_EQ, OP_NE,
+	OP_SLT, OP_SLE, OP_SGT, OP_SGE, OP_ULT, OP_ULE, OP_UGT, OP_UGE,
+	OP_EXTRACT, OP_ZEXT, OP_SEXT, OP_REDAND, OP_REDOR, OP_NOT, OP_NEG,
+	OP_ADD, OP_SUB, OP_MUL, OP_SDIV, OP_UDIV, OP_SREM, OP_UREM,
+	OP_SHL, OP_LSHR, OP_ASHR, OP_AND, OP_OR, OP_XOR,
+	OP_NEG_OV, OP_SADD_OV, OP_UADD_OV, OP_SSUB_OV, OP_USUB_OV,
+	OP_SMUL_OV, OP_UMUL_OV, OP_SDIV_OV,
+};
+
+// Keep a reference to each recorded expression, so that the backend
+// does not reuse it for another one; an expression returned again,
+// e.g., after rewriting, keeps its first shape.
+SMTExpr SMTSolver::shape(SMTExpr e, unsigned op, SMTExpr a, SMTExpr b,
+                         SMTExpr c, uint64_t imm) {
+	if (!getCache() || shapes_.count(e))
+		return e;
+	Shape s = { op, { a, b, c }, imm };
+	shapes_[e] = s;
+	incref(e);
+	return e;
+}
+
+void SMTSolver::clear_shapes() {
+	for (DenseMap<SMTExpr, Shape>::iterator i = shapes_.begin(),
+	     e = shapes_.end(); i != e; ++i)
+		decref(i->first);
+	shapes_.clear();
+	for (unsigned i = 0; i != assumptions_.size(); ++i)
+		decref(assumptions_[i]);
+	assumptions_.clear();
 }
+
+void SMTSolver::assume(SMTExpr e) {
+	if (getCache()) {
+		incref(e);
+		assumptions_.push_back(e);
+	}
+	constrain(e);
+}
+
+// Seed of the check hash, any constant other than 0.
+static const uint64_t CheckSeed = 0x5bd1e9955bd1e995ULL;
+
+uint64_t SMTSolver::hash(SMTExpr e, uint64_t *check) {
+	uint64_t h = seeded_hash(e, 0);
+	*check = h ? seeded_hash(e, CheckSeed) : 0;
+	return h;
+}
+
+uint64_t SMTSolver::seeded_hash(SMTExpr e, uint64_t seed) {
+	DenseMap<SMTExpr, uint64_t> memo;
+	unsigned vars = 0;
+	uint64_t h = hash(e, seed, memo, vars);
+	if (!h || assumptions_.empty())
+		return h;
+
+	// Pick the assumptions that share variables with the formula or
+	// with assumptions picked before; others do not affect the result,
+	// unless they are unsatisfiable themselves.
+	unsigned n = assumptions_.size();
+	std::vector<DenseSet<SMTExpr> > avars(n);
+	for (unsigned i = 0; i != n; ++i) {
+		DenseSet<SMTExpr> seen;
+		collect_vars(assumptions_[i], seen, avars[i]);
+	}
+	DenseSet<SMTExpr> seen, qvars;
+	collect_vars(e, seen, qvars);
+	std::vector<bool> picked(n);
+	for (bool grew = true; grew; ) {
+		grew = false;
+		for (unsigned i = 0; i != n; ++i) {
+			if (picked[i])
+				continue;
+			bool shared = avars[i].empty();
+			for (DenseSet<SMTExpr>::iterator v = avars[i].begin(),
+			     ve = avars[i].end(); v != ve && !shared; ++v)
+				shared = qvars.count(*v);
+			if (!shared)
+				continue;
+			picked[i] = grew = true;
+			qvars.insert(avars[i].begin(), avars[i].end());
+		}
+	}
+	for (unsigned i = 0; i != n; ++i) {
+		if (!picked[i])
+			continue;
+		uint64_t sub = hash(assumptions_[i], seed, memo, vars);
+		if (!sub)
+			return 0;
+		h = mix(h, sub);
+	}
+	return h ? h : 1;
+}
+
+void SMTSolver::collect_vars(SMTExpr e, DenseSet<SMTExpr> &seen,
+                             DenseSet<SMTExpr> &vars) {
+	if (!seen.insert(e).second)
+		return;
+	DenseMap<SMTExpr, Shape>::iterator i = shapes_.find(e);
+	if (i == shapes_.end())
+		return;
+	const Shape &s = i->second;
+	if (s.op == OP_VAR)
+		vars.insert(e);
+	for (unsigned k = 0; k != 3 && s.ops[k]; ++k)
+		collect_vars(s.ops[k], seen, vars);
+}
+
+// Variables are numbered in the order of a depth-first traversal.
+uint64_t SMTSolver::hash(SMTExpr e, uint64_t seed,
+                         DenseMap<SMTExpr, uint64_t> &memo, unsigned &vars) {
+	uint64_t h = memo.lookup(e);
+	if (h)
+		return h;
+	DenseMap<SMTExpr, Shape>::iterator i = shapes_.find(e);
+	if (i == shapes_.end())
+		return 0;
+	const Shape &s = i->second;
+	h = mix(mix(seed, s.op), s.imm);
+	if (s.op == OP_VAR)
+		h = mix(h, vars++);
+	for (unsigned k = 0; k != 3 && s.ops[k]; ++k) {
+		uint64_t sub = hash(s.ops[k], seed, memo, vars);
+		if (!sub)
+			return 0;
+		h = mix(h, sub);
+	}
+	if (!h)
+		h = 1;
+	memo[e] = h;
+	return h;
+}
+
+SMTExpr SMTSolver::bvfalse() {
+	return shape(mk_bvfalse(), OP_FALSE);
+}
+
+SMTExpr SMTSolver::bvtrue() {
+	return shape(mk_bvtrue(), OP_TRUE);
+}
+
+SMTExpr SMTSolver::bvconst(const APInt &Val) {
+	uint64_t imm = Val.getBitWidth();
+	for (unsigned i = 0; i != Val.getNumWords(); ++i)
+		imm = mix(imm, Val.getRawData()[i]);
+	return shape(mk_bvconst(Val), OP_CONST, 0, 0, 0, imm);
+}
+
+SMTExpr SMTSolver::bvvar(unsigned width, const char *name) {
+	return shape(mk_bvvar(width, name), OP_VAR, 0, 0, 0, width);
+}
+
+SMTExpr SMTSolver::ite(SMTExpr c, SMTExpr a, SMTExpr b) {
+	return shape(mk_ite(c, a, b), OP_ITE, c, a, b);
+}
+
+SMTExpr SMTSolver::extract(unsigned high, unsigned low, SMTExpr a) {
+	uint64_t imm = ((uint64_t)high << 32) | low;
+	return shape(mk_extract(high, low, a), OP_EXTRACT, a, 0, 0, imm);
+}
+
+SMTExpr SMTSolver::zero_extend(unsigned i, SMTExpr a) {
+	return shape(mk_zero_extend(i, a), OP_ZEXT, a, 0, 0, i);
+}
+
+SMTExpr SMTSolver::sign_extend(unsigned i, SMTExpr a) {
+	return shape(mk_sign_extend(i, a), OP_SEXT, a, 0, 0, i);
+}
+
+#define UNARY(name, op) \
+	SMTExpr SMTSolver::name(SMTExpr a) { \
+		return shape(mk_##name(a), op, a); \
+	}
+
+#define BINARY(name, op) \
+	SMTExpr SMTSolver::name(SMTExpr a, SMTExpr b) { \
+		return shape(mk_##name(a, b), op, a, b); \
+	}
+
+BINARY(eq, OP_EQ)
+BINARY(ne, OP_NE)
+BINARY(bvslt, OP_SLT)
+BINARY(bvsle, OP_SLE)
+BINARY(bvsgt, OP_SGT)
+BINARY(bvsge, OP_SGE)
+BINARY(bvult, OP_ULT)
+BINARY(bvule, OP_ULE)
+BINARY(bvugt, OP_UGT)
+BINARY(bvuge, OP_UGE)
+UNARY(bvredand, OP_REDAND)
+UNARY(bvredor, OP_REDOR)
+UNARY(bvnot, OP_NOT)
+UNARY(bvneg, OP_NEG)
+BINARY(bvadd, OP_ADD)
+BINARY(bvsub, OP_SUB)
+BINARY(bvmul, OP_MUL)
+BINARY(bvsdiv, OP_SDIV)
+BINARY(bvudiv, OP_UDIV)
+BINARY(bvsrem, OP_SREM)
+BINARY(bvurem, OP_UREM)
+BINARY(bvshl, OP_SHL)
+BINARY(bvlshr, OP_LSHR)
+BINARY(bvashr, OP_ASHR)
+BINARY(bvand, OP_AND)
+BINARY(bvor, OP_OR)
+BINARY(bvxor, OP_XOR)
+UNARY(bvneg_overflow, OP_NEG_OV)
+BINARY(bvsadd_overflow, OP_SADD_OV)
+BINARY(bvuadd_overflow, OP_UADD_OV)
+BINARY(bvssub_overflow, OP_SSUB_OV)
+BINARY(bvusub_overflow, OP_USUB_OV)
+BINARY(bvsmul_overflow, OP_SMUL_OV)
+BINARY(bvumul_overflow, OP_UMUL_OV)
+BINARY(bvsdiv_overflow, OP_SDIV_OV)
+
+#undef UNARY
+#undef BINARY
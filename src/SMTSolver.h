@@ -1,5 +1,11 @@
 #pragma once
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/Support/DataTypes.h>
+#include <string>
+#include <vector>
+
 namespace llvm {
 	class APInt;
 	class raw_ostream;
@@ -16,27 +22,65 @@ typedef void *SMTContext;
 typedef void *SMTExpr;
 typedef void *SMTModel;
 
+// With -smt-fork, run a query in a child process, which the timeout
+// kills without affecting the analysis; otherwise these do nothing.
+// A child that crashes yields SMT_UNDEF, which is not cached.
 int SMTFork();
 void SMTJoin(int *);
 
+// Results of earlier queries in the file given by -smt-cache, keyed by
+// SMTSolver::hash and shared by concurrent processes.  A result is
+// used only if its check hash matches too.  Lookup returns false if the
+// cache is disabled or has no usable result; a timeout is usable only
+// if it took at least the current -smt-timeout, measured in the same
+// way (CPU time with -smt-fork, wall-clock time otherwise).
+bool SMTCacheLookup(uint64_t key, uint64_t check, int *);
+void SMTCacheInsert(uint64_t key, uint64_t check, int);
+
+// Solvers of the backends registered with RegisterSMTBackend.  Public
+// builders record expressions for hash() and call the mk_* methods of
+// the backend.
 class SMTSolver {
 public:
-	SMTSolver(bool modelgen);
-	~SMTSolver();
+	virtual ~SMTSolver() {}
+
+	// A solver of the backend chosen by -smt-backend.
+	static SMTSolver *create(bool modelgen);
+
+	// Name and version of that backend; a query cache of another
+	// backend is discarded.
+	static std::string version();
 
+	// Hash of the formula and of the assumptions sharing variables with
+	// it, directly or through other assumptions, equal for formulas that
+	// differ only in the names of variables; 0 if unknown.  A second
+	// hash with another seed is stored in check, for the cache to tell
+	// apart formulas whose first hashes collide.
+	uint64_t hash(SMTExpr, uint64_t *check);
+
+	// Constrain all later queries.
 	void assume(SMTExpr);
 
+	// Unless forked, a query running past -smt-timeout is stopped
+	// and returns SMT_TIMEOUT.
 	SMTStatus query(SMTExpr, SMTModel * = 0);
-	void eval(SMTModel, SMTExpr, llvm::APInt &);
-	void release(SMTModel);
+	// Stop the running query from another thread.
+	void stop();
+	// Whether the last query was stopped.  A stopped Boolector
+	// instance cannot answer further queries.
+	bool interrupted() const { return interrupted_; }
+	// Whether the solver answers further queries after being stopped.
+	virtual bool resumable() const { return true; }
+	virtual void eval(SMTModel, SMTExpr, llvm::APInt &) = 0;
+	virtual void release(SMTModel) = 0;
 
 	void dump(SMTExpr);
-	void print(SMTExpr, llvm::raw_ostream &);
+	virtual void print(SMTExpr, llvm::raw_ostream &) = 0;
 
-	void incref(SMTExpr);
-	void decref(SMTExpr);
+	virtual void incref(SMTExpr) = 0;
+	virtual void decref(SMTExpr) = 0;
 
-	unsigned bvwidth(SMTExpr);
+	virtual unsigned bvwidth(SMTExpr) = 0;
 
 	SMTExpr bvfalse();
 	SMTExpr bvtrue();
@@ -92,6 +136,128 @@ public:
 	SMTExpr bvumul_overflow(SMTExpr, SMTExpr);
 	SMTExpr bvsdiv_overflow(SMTExpr, SMTExpr);
 
+protected:
+	// Runs members through their backend implementations.
+	friend class SMTPortfolio;
+
+	SMTSolver() : interrupted_(false) {}
+
+	// Drop references to recorded expressions; backends call this
+	// first on destruction.
+	void clear_shapes();
+
+	// Whether queries may be stopped, by the -smt-timeout watchdog or
+	// by a portfolio.  Backends that solve slower once they can be
+	// stopped enable stopping only then.
+	static bool stoppable();
+
+	// Backend implementations of assume and query, and of stop, which
+	// is called from another thread.
+	virtual void constrain(SMTExpr) = 0;
+	virtual SMTStatus solve(SMTExpr, SMTModel *) = 0;
+	virtual void interrupt() = 0;
+
+	// Backend implementations of the expression builders above.
+	virtual SMTExpr mk_bvfalse() = 0;
+	virtual SMTExpr mk_bvtrue() = 0;
+	virtual SMTExpr mk_bvconst(const llvm::APInt &) = 0;
+	virtual SMTExpr mk_bvvar(unsigned width, const char *name) = 0;
+	virtual SMTExpr mk_ite(SMTExpr, SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_eq(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_ne(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvslt(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvsle(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvsgt(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvsge(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvult(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvule(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvugt(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvuge(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_extract(unsigned high, unsigned low, SMTExpr) = 0;
+	virtual SMTExpr mk_zero_extend(unsigned i, SMTExpr) = 0;
+	virtual SMTExpr mk_sign_extend(unsigned i, SMTExpr) = 0;
+	virtual SMTExpr mk_bvredand(SMTExpr) = 0;
+	virtual SMTExpr mk_bvredor(SMTExpr) = 0;
+	virtual SMTExpr mk_bvnot(SMTExpr) = 0;
+	virtual SMTExpr mk_bvneg(SMTExpr) = 0;
+	virtual SMTExpr mk_bvadd(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvsub(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvmul(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvsdiv(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvudiv(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvsrem(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvurem(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvshl(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvlshr(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvashr(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvand(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvor(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvxor(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvneg_overflow(SMTExpr) = 0;
+	virtual SMTExpr mk_bvsadd_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvuadd_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvssub_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvusub_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvsmul_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvumul_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr mk_bvsdiv_overflow(SMTExpr, SMTExpr) = 0;
+
 private:
-	SMTContext ctx_;
+	volatile bool interrupted_;
+
+	// Operator and operands of expressions built so far, for hash().
+	struct Shape {
+		unsigned op;
+		SMTExpr ops[3];
+		uint64_t imm;
+	};
+	llvm::DenseMap<SMTExpr, Shape> shapes_;
+	// Assumptions so far, in order.
+	std::vector<SMTExpr> assumptions_;
+
+	SMTExpr shape(SMTExpr, unsigned op, SMTExpr = 0, SMTExpr = 0,
+	              SMTExpr = 0, uint64_t imm = 0);
+	uint64_t seeded_hash(SMTExpr, uint64_t seed);
+	uint64_t hash(SMTExpr, uint64_t seed,
+	              llvm::DenseMap<SMTExpr, uint64_t> &, unsigned &vars);
+	void collect_vars(SMTExpr, llvm::DenseSet<SMTExpr> &seen,
+	                  llvm::DenseSet<SMTExpr> &vars);
+};
+
+// A backend, selected by name with -smt-backend.
+class SMTBackend {
+public:
+	typedef SMTSolver *(*CreateFn)(bool modelgen);
+	typedef std::string (*VersionFn)();
+
+	SMTBackend(const char *name, const char *desc, CreateFn, VersionFn);
+
+	const char *name;
+	const char *desc;
+	CreateFn create;
+	VersionFn version;
+
+	// The backend of -smt-backend; exits if there is none.
+	static SMTBackend &get();
+	// The backend of the name; exits if there is none.
+	static SMTBackend &find(const std::string &name);
+
+private:
+	SMTBackend *next;
+	static SMTBackend *list;
+
+	static SMTBackend *lookup(const std::string &name);
+};
+
+// Register a backend class T, constructed from the modelgen flag and
+// providing a static version(), e.g.,
+//   static RegisterSMTBackend<SMTZ3> Backend("z3", "Z3");
+template <typename T>
+struct RegisterSMTBackend : SMTBackend {
+	RegisterSMTBackend(const char *name, const char *desc)
+		: SMTBackend(name, desc, make, T::version) {}
+
+	static SMTSolver *make(bool modelgen) {
+		return new T(modelgen);
+	}
 };
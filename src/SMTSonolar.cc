@@ -7,27 +7,106 @@
 
 using namespace llvm;
 
+namespace {
+
+class SMTSonolar : public SMTSolver {
+public:
+	SMTSonolar(bool modelgen);
+	~SMTSonolar();
+
+	static std::string version();
+
+	void eval(SMTModel, SMTExpr, llvm::APInt &);
+	void release(SMTModel);
+	void print(SMTExpr, llvm::raw_ostream &);
+	void incref(SMTExpr);
+	void decref(SMTExpr);
+	unsigned bvwidth(SMTExpr);
+
+protected:
+	void constrain(SMTExpr);
+	SMTStatus solve(SMTExpr, SMTModel *);
+	void interrupt();
+
+	SMTExpr mk_bvfalse();
+	SMTExpr mk_bvtrue();
+	SMTExpr mk_bvconst(const llvm::APInt &);
+	SMTExpr mk_bvvar(unsigned width, const char *name);
+	SMTExpr mk_ite(SMTExpr, SMTExpr, SMTExpr);
+	SMTExpr mk_eq(SMTExpr, SMTExpr);
+	SMTExpr mk_ne(SMTExpr, SMTExpr);
+	SMTExpr mk_bvslt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsle(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsgt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsge(SMTExpr, SMTExpr);
+	SMTExpr mk_bvult(SMTExpr, SMTExpr);
+	SMTExpr mk_bvule(SMTExpr, SMTExpr);
+	SMTExpr mk_bvugt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvuge(SMTExpr, SMTExpr);
+	SMTExpr mk_extract(unsigned high, unsigned low, SMTExpr);
+	SMTExpr mk_zero_extend(unsigned i, SMTExpr);
+	SMTExpr mk_sign_extend(unsigned i, SMTExpr);
+	SMTExpr mk_bvredand(SMTExpr);
+	SMTExpr mk_bvredor(SMTExpr);
+	SMTExpr mk_bvnot(SMTExpr);
+	SMTExpr mk_bvneg(SMTExpr);
+	SMTExpr mk_bvadd(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsub(SMTExpr, SMTExpr);
+	SMTExpr mk_bvmul(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsdiv(SMTExpr, SMTExpr);
+	SMTExpr mk_bvudiv(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsrem(SMTExpr, SMTExpr);
+	SMTExpr mk_bvurem(SMTExpr, SMTExpr);
+	SMTExpr mk_bvshl(SMTExpr, SMTExpr);
+	SMTExpr mk_bvlshr(SMTExpr, SMTExpr);
+	SMTExpr mk_bvashr(SMTExpr, SMTExpr);
+	SMTExpr mk_bvand(SMTExpr, SMTExpr);
+	SMTExpr mk_bvor(SMTExpr, SMTExpr);
+	SMTExpr mk_bvxor(SMTExpr, SMTExpr);
+	SMTExpr mk_bvneg_overflow(SMTExpr);
+	SMTExpr mk_bvsadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvuadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvssub_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvusub_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsmul_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvumul_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsdiv_overflow(SMTExpr, SMTExpr);
+
+private:
+	SMTContext ctx_;
+};
+
+} // anonymous namespace
+
 #define ctx ((sonolar_t)ctx_)
 #define m   ((sonolar_t *)m_)
 #define e   ((sonolar_term_t *)e_)
 #define lhs ((sonolar_term_t *)lhs_)
 #define rhs ((sonolar_term_t *)rhs_)
 
-SMTSolver::SMTSolver(bool /*modelgen*/) {
+SMTSonolar::SMTSonolar(bool /*modelgen*/) {
 	ctx_ = sonolar_create();
 	if (sonolar_set_sat_solver(ctx, SONOLAR_SAT_SOLVER_MINISAT))
 		assert(0 && "sonolar_set_sat_solver");
 }
 
-SMTSolver::~SMTSolver() {
+SMTSonolar::~SMTSonolar() {
+	clear_shapes();
 	sonolar_destroy(ctx);
 }
 
-void SMTSolver::assume(SMTExpr e_) {
+static RegisterSMTBackend<SMTSonolar>
+Backend("sonolar", "SONOLAR");
+
+std::string SMTSonolar::version() {
+	return "sonolar";
+}
+
+void SMTSonolar::constrain(SMTExpr e_) {
 	sonolar_assert_formula(ctx, e);
 }
 
-SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
+SMTStatus SMTSonolar::solve(SMTExpr e_, SMTModel *m_) {
 	if (sonolar_assume_formula(ctx, e))
 		assert(0 && "sonolar_assume_formula");
 	switch (sonolar_solve(ctx)) {
@@ -40,215 +119,213 @@ SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
 	return SMT_SAT;
 }
 
-void SMTSolver::eval(SMTModel m_, SMTExpr e_, APInt &) {
+// Sonolar cannot be stopped; use -smt-fork.
+void SMTSonolar::interrupt() {}
+
+void SMTSonolar::eval(SMTModel m_, SMTExpr e_, APInt &) {
 	assert(0 && "NOT SUPPORTED");
 }
 
-void SMTSolver::release(SMTModel m_) {}
-
-void SMTSolver::dump(SMTExpr e_) {
-	print(e, dbgs());
-	dbgs() << "\n";
-}
+void SMTSonolar::release(SMTModel m_) {}
 
-void SMTSolver::print(SMTExpr e_, raw_ostream &OS) {
+void SMTSonolar::print(SMTExpr e_, raw_ostream &OS) {
 	OS << "NOT SUPPORTED";
 }
 
-void SMTSolver::incref(SMTExpr e_) {
+void SMTSonolar::incref(SMTExpr e_) {
 	sonolar_add_reference(ctx, e);
 }
 
-void SMTSolver::decref(SMTExpr e_) {
+void SMTSonolar::decref(SMTExpr e_) {
 	sonolar_remove_reference(ctx, e);
 }
 
-unsigned SMTSolver::bvwidth(SMTExpr e_) {
+unsigned SMTSonolar::bvwidth(SMTExpr e_) {
 	size_t width;
 	if (sonolar_get_bitwidth(ctx, e, &width))
 		assert(0 && "sonolar_get_bitwidth");
 	return (unsigned)width;
 }
 
-SMTExpr SMTSolver::bvfalse() {
+SMTExpr SMTSonolar::mk_bvfalse() {
 	return sonolar_make_constant_false(ctx);
 }
 
-SMTExpr SMTSolver::bvtrue() {
+SMTExpr SMTSonolar::mk_bvtrue() {
 	return sonolar_make_constant_true(ctx);
 }
 
-SMTExpr SMTSolver::bvconst(const APInt &Val) {
+SMTExpr SMTSonolar::mk_bvconst(const APInt &Val) {
 	const void *data = Val.getRawData();
 	unsigned width = Val.getBitWidth();
 	return sonolar_make_constant_bytes(ctx, data, width, SONOLAR_BYTE_ORDER_NATIVE);
 }
 
-SMTExpr SMTSolver::bvvar(unsigned width, const char *name) {
+SMTExpr SMTSonolar::mk_bvvar(unsigned width, const char *name) {
 	return sonolar_make_variable(ctx, width, name);
 }
 
-SMTExpr SMTSolver::ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_ite(ctx, e, lhs, rhs);
 }
 
-SMTExpr SMTSolver::eq(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_eq(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_equal(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::ne(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_ne(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_distinct(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvslt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvslt(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_slt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsle(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvsle(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sle(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sgt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvsge(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sge(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvult(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvult(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_ult(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvule(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvule(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_ule(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvugt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvugt(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_ugt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvuge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvuge(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_uge(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::extract(unsigned high, unsigned low, SMTExpr e_) {
+SMTExpr SMTSonolar::mk_extract(unsigned high, unsigned low, SMTExpr e_) {
 	return sonolar_make_bv_extract(ctx, e, high, low);
 }
 
-SMTExpr SMTSolver::zero_extend(unsigned i, SMTExpr e_) {
+SMTExpr SMTSonolar::mk_zero_extend(unsigned i, SMTExpr e_) {
 	return sonolar_make_bv_zero_extend(ctx, e, i);
 }
 
-SMTExpr SMTSolver::sign_extend(unsigned i, SMTExpr e_) {
+SMTExpr SMTSonolar::mk_sign_extend(unsigned i, SMTExpr e_) {
 	return sonolar_make_bv_sign_extend(ctx, e, i);
 }
 
-SMTExpr SMTSolver::bvredand(SMTExpr e_) {
-	SMTExpr neg = bvnot(e);
+SMTExpr SMTSonolar::mk_bvredand(SMTExpr e_) {
+	SMTExpr neg = mk_bvnot(e);
 	SMTExpr tmp = sonolar_make_is_zero(ctx, neg);
 	decref(neg);
 	return tmp;
 }
 
-SMTExpr SMTSolver::bvredor(SMTExpr e_) {
+SMTExpr SMTSonolar::mk_bvredor(SMTExpr e_) {
 	SMTExpr z = sonolar_make_is_zero(ctx, e);
 	SMTExpr nz = sonolar_make_not(ctx, z);
 	decref(z);
 	return nz;
 }
 
-SMTExpr SMTSolver::bvnot(SMTExpr e_) {
+SMTExpr SMTSonolar::mk_bvnot(SMTExpr e_) {
 	return sonolar_make_bv_not(ctx, e);
 }
 
-SMTExpr SMTSolver::bvneg(SMTExpr e_) {
+SMTExpr SMTSonolar::mk_bvneg(SMTExpr e_) {
 	return sonolar_make_bv_neg(ctx, e);
 }
 
-SMTExpr SMTSolver::bvadd(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvadd(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_add(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsub(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvsub(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sub(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvmul(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvmul(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_mul(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sdiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_udiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_srem(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvurem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvurem(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_urem(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvshl(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvshl(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_shl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_lshr(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvashr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvashr(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_ashr(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvand(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvand(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_and(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvor(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_or(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvxor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvxor(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_xor(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvneg_overflow(SMTExpr e_) {
+SMTExpr SMTSonolar::mk_bvneg_overflow(SMTExpr e_) {
 	SMTExpr zero = sonolar_make_constant_0_bits(ctx, bvwidth(e));
-	SMTExpr tmp = bvssub_overflow(zero, e);
+	SMTExpr tmp = mk_bvssub_overflow(zero, e);
 	decref(zero);
 	return tmp;
 }
 
-SMTExpr SMTSolver::bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sadd_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_uadd_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_ssub_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_usub_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_smul_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_umul_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTSonolar::mk_bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sdiv_ovfl(ctx, lhs, rhs);
 }
@@ -8,12 +8,83 @@
 
 using namespace llvm;
 
+namespace {
+
 struct SMTContextImpl {
 	Z3_context c;
 	Z3_ast bvfalse;
 	Z3_ast bvtrue;
 };
 
+class SMTZ3 : public SMTSolver {
+public:
+	SMTZ3(bool modelgen);
+	~SMTZ3();
+
+	static std::string version();
+
+	void eval(SMTModel, SMTExpr, llvm::APInt &);
+	void release(SMTModel);
+	void print(SMTExpr, llvm::raw_ostream &);
+	void incref(SMTExpr);
+	void decref(SMTExpr);
+	unsigned bvwidth(SMTExpr);
+
+protected:
+	void constrain(SMTExpr);
+	SMTStatus solve(SMTExpr, SMTModel *);
+	void interrupt();
+
+	SMTExpr mk_bvfalse();
+	SMTExpr mk_bvtrue();
+	SMTExpr mk_bvconst(const llvm::APInt &);
+	SMTExpr mk_bvvar(unsigned width, const char *name);
+	SMTExpr mk_ite(SMTExpr, SMTExpr, SMTExpr);
+	SMTExpr mk_eq(SMTExpr, SMTExpr);
+	SMTExpr mk_ne(SMTExpr, SMTExpr);
+	SMTExpr mk_bvslt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsle(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsgt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsge(SMTExpr, SMTExpr);
+	SMTExpr mk_bvult(SMTExpr, SMTExpr);
+	SMTExpr mk_bvule(SMTExpr, SMTExpr);
+	SMTExpr mk_bvugt(SMTExpr, SMTExpr);
+	SMTExpr mk_bvuge(SMTExpr, SMTExpr);
+	SMTExpr mk_extract(unsigned high, unsigned low, SMTExpr);
+	SMTExpr mk_zero_extend(unsigned i, SMTExpr);
+	SMTExpr mk_sign_extend(unsigned i, SMTExpr);
+	SMTExpr mk_bvredand(SMTExpr);
+	SMTExpr mk_bvredor(SMTExpr);
+	SMTExpr mk_bvnot(SMTExpr);
+	SMTExpr mk_bvneg(SMTExpr);
+	SMTExpr mk_bvadd(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsub(SMTExpr, SMTExpr);
+	SMTExpr mk_bvmul(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsdiv(SMTExpr, SMTExpr);
+	SMTExpr mk_bvudiv(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsrem(SMTExpr, SMTExpr);
+	SMTExpr mk_bvurem(SMTExpr, SMTExpr);
+	SMTExpr mk_bvshl(SMTExpr, SMTExpr);
+	SMTExpr mk_bvlshr(SMTExpr, SMTExpr);
+	SMTExpr mk_bvashr(SMTExpr, SMTExpr);
+	SMTExpr mk_bvand(SMTExpr, SMTExpr);
+	SMTExpr mk_bvor(SMTExpr, SMTExpr);
+	SMTExpr mk_bvxor(SMTExpr, SMTExpr);
+	SMTExpr mk_bvneg_overflow(SMTExpr);
+	SMTExpr mk_bvsadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvuadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvssub_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvusub_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsmul_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvumul_overflow(SMTExpr, SMTExpr);
+	SMTExpr mk_bvsdiv_overflow(SMTExpr, SMTExpr);
+
+private:
+	SMTContext ctx_;
+};
+
+} // anonymous namespace
+
 #define imp ((SMTContextImpl *)ctx_)
 #define ctx (imp->c)
 #define m   ((Z3_model)m_)
@@ -32,7 +103,7 @@ static inline Z3_ast bool2bv_(SMTContextImpl *ctx_, Z3_ast e0) {
 #define bv2bool(x) bv2bool_(imp, x)
 #define bool2bv(x) bool2bv_(imp, x)
 
-SMTSolver::SMTSolver(bool modelgen) {
+SMTZ3::SMTZ3(bool modelgen) {
 	ctx_ = new SMTContextImpl;
 	Z3_config cfg = Z3_mk_config();
 	// Enable model construction.
@@ -46,16 +117,29 @@ SMTSolver::SMTSolver(bool modelgen) {
 	imp->bvtrue = Z3_mk_int(ctx, 1, sort);
 }
 
-SMTSolver::~SMTSolver() {
+SMTZ3::~SMTZ3() {
+	clear_shapes();
 	Z3_del_context(ctx);
 	delete imp;
 }
 
-void SMTSolver::assume(SMTExpr e_) {
+static RegisterSMTBackend<SMTZ3>
+Backend("z3", "Z3");
+
+std::string SMTZ3::version() {
+	unsigned v[4];
+	Z3_get_version(&v[0], &v[1], &v[2], &v[3]);
+	std::string s;
+	raw_string_ostream(s) << "z3-" << v[0] << '.' << v[1] << '.'
+	                      << v[2] << '.' << v[3];
+	return s;
+}
+
+void SMTZ3::constrain(SMTExpr e_) {
 	Z3_assert_cnstr(ctx, bv2bool(e));
 }
 
-SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
+SMTStatus SMTZ3::solve(SMTExpr e_, SMTModel *m_) {
 	Z3_push(ctx);
 	Z3_assert_cnstr(ctx, bv2bool(e));
 	Z3_lbool res = Z3_check_and_get_model(ctx, (Z3_model *)m_);
@@ -67,7 +151,11 @@ SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
 	}
 }
 
-void SMTSolver::eval(SMTModel m_, SMTExpr e_, APInt &r) {
+void SMTZ3::interrupt() {
+	Z3_interrupt(ctx);
+}
+
+void SMTZ3::eval(SMTModel m_, SMTExpr e_, APInt &r) {
 	Z3_ast v = 0;
 	Z3_bool ret = Z3_model_eval(ctx, m, e, Z3_TRUE, &v);
 	assert(ret);
@@ -90,36 +178,31 @@ void SMTSolver::eval(SMTModel m_, SMTExpr e_, APInt &r) {
 	assert(0);
 }
 
-void SMTSolver::release(SMTModel m_) {
+void SMTZ3::release(SMTModel m_) {
 	Z3_del_model(ctx, m);
 }
 
-void SMTSolver::dump(SMTExpr e_) {
-	print(e, dbgs());
-	dbgs() << "\n";
-}
-
-void SMTSolver::print(SMTExpr e_, raw_ostream &OS) {
+void SMTZ3::print(SMTExpr e_, raw_ostream &OS) {
 	OS << Z3_ast_to_string(ctx, Z3_simplify(ctx, e));
 }
 
 // Managed by Z3, no reference counting.
-void SMTSolver::incref(SMTExpr) { }
-void SMTSolver::decref(SMTExpr) { }
+void SMTZ3::incref(SMTExpr) { }
+void SMTZ3::decref(SMTExpr) { }
 
-unsigned SMTSolver::bvwidth(SMTExpr e_) {
+unsigned SMTZ3::bvwidth(SMTExpr e_) {
 	return Z3_get_bv_sort_size(ctx, Z3_get_sort(ctx, e));
 }
 
-SMTExpr SMTSolver::bvfalse() {
+SMTExpr SMTZ3::mk_bvfalse() {
 	return imp->bvfalse;
 }
 
-SMTExpr SMTSolver::bvtrue() {
+SMTExpr SMTZ3::mk_bvtrue() {
 	return imp->bvtrue;
 }
 
-SMTExpr SMTSolver::bvconst(const APInt &Val) {
+SMTExpr SMTZ3::mk_bvconst(const APInt &Val) {
 	unsigned width = Val.getBitWidth();
 	Z3_sort t = Z3_mk_bv_sort(ctx, width);
 	if (width <= 64)
@@ -129,171 +212,171 @@ SMTExpr SMTSolver::bvconst(const APInt &Val) {
 	return Z3_mk_numeral(ctx, s.c_str(), t);
 }
 
-SMTExpr SMTSolver::bvvar(unsigned width, const char *name) {
+SMTExpr SMTZ3::mk_bvvar(unsigned width, const char *name) {
 	return Z3_mk_const(ctx, Z3_mk_string_symbol(ctx, name), Z3_mk_bv_sort(ctx, width));
 }
 
-SMTExpr SMTSolver::ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_ite(ctx, bv2bool(e), lhs, rhs);
 }
 
-SMTExpr SMTSolver::eq(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_eq(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_eq(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::ne(SMTExpr lhs_, SMTExpr rhs_) {
-	return bvnot(eq(lhs_, rhs_));
+SMTExpr SMTZ3::mk_ne(SMTExpr lhs_, SMTExpr rhs_) {
+	return mk_bvnot(mk_eq(lhs_, rhs_));
 }
 
-SMTExpr SMTSolver::bvslt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvslt(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvslt(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvsle(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvsle(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvsle(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvsgt(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvsge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvsge(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvsge(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvult(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvult(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvult(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvule(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvule(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvule(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvugt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvugt(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvugt(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvuge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvuge(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvuge(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::extract(unsigned high, unsigned low, SMTExpr e_) {
+SMTExpr SMTZ3::mk_extract(unsigned high, unsigned low, SMTExpr e_) {
 	return Z3_mk_extract(ctx, high, low, e);
 }
 
-SMTExpr SMTSolver::zero_extend(unsigned i, SMTExpr e_) {
+SMTExpr SMTZ3::mk_zero_extend(unsigned i, SMTExpr e_) {
 	return Z3_mk_zero_ext(ctx, i, e);
 }
 
-SMTExpr SMTSolver::sign_extend(unsigned i, SMTExpr e_) {
+SMTExpr SMTZ3::mk_sign_extend(unsigned i, SMTExpr e_) {
 	return Z3_mk_sign_ext(ctx, i, e);
 }
 
-SMTExpr SMTSolver::bvredand(SMTExpr e_) {
+SMTExpr SMTZ3::mk_bvredand(SMTExpr e_) {
 	return Z3_mk_bvredand(ctx, e);
 }
 
-SMTExpr SMTSolver::bvredor(SMTExpr e_) {
+SMTExpr SMTZ3::mk_bvredor(SMTExpr e_) {
 	return Z3_mk_bvredor(ctx, e);
 }
 
-SMTExpr SMTSolver::bvnot(SMTExpr e_) {
+SMTExpr SMTZ3::mk_bvnot(SMTExpr e_) {
 	return Z3_mk_bvnot(ctx, e);
 }
 
-SMTExpr SMTSolver::bvneg(SMTExpr e_) {
+SMTExpr SMTZ3::mk_bvneg(SMTExpr e_) {
 	return Z3_mk_bvneg(ctx, e);
 }
 
-SMTExpr SMTSolver::bvadd(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvadd(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvadd(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsub(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvsub(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvsub(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvmul(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvmul(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvmul(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvsdiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvudiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvsrem(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvurem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvurem(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvurem(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvshl(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvshl(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvshl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvlshr(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvashr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvashr(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvashr(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvand(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvand(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvand(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvor(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvor(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvxor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SMTZ3::mk_bvxor(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvxor(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvneg_overflow(SMTExpr e_) {
-	return bvnot(bool2bv(Z3_mk_bvneg_no_overflow(ctx, e)));
+SMTExpr SMTZ3::mk_bvneg_overflow(SMTExpr e_) {
+	return mk_bvnot(bool2bv(Z3_mk_bvneg_no_overflow(ctx, e)));
 }
 
-SMTExpr SMTSolver::bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
-	return bvor(
-		bvnot(bool2bv(Z3_mk_bvadd_no_overflow(ctx, lhs, rhs, Z3_TRUE))),
-		bvnot(bool2bv(Z3_mk_bvadd_no_underflow(ctx, lhs, rhs)))
+SMTExpr SMTZ3::mk_bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+	return mk_bvor(
+		mk_bvnot(bool2bv(Z3_mk_bvadd_no_overflow(ctx, lhs, rhs, Z3_TRUE))),
+		mk_bvnot(bool2bv(Z3_mk_bvadd_no_underflow(ctx, lhs, rhs)))
 	);
 }
 
-SMTExpr SMTSolver::bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
-	return bvnot(bool2bv(Z3_mk_bvadd_no_overflow(ctx, lhs, rhs, Z3_FALSE)));
+SMTExpr SMTZ3::mk_bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+	return mk_bvnot(bool2bv(Z3_mk_bvadd_no_overflow(ctx, lhs, rhs, Z3_FALSE)));
 }
 
-SMTExpr SMTSolver::bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
-	return bvor(
-		bvnot(bool2bv(Z3_mk_bvsub_no_overflow(ctx, lhs, rhs))),
-		bvnot(bool2bv(Z3_mk_bvsub_no_underflow(ctx, lhs, rhs, Z3_TRUE)))
+SMTExpr SMTZ3::mk_bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+	return mk_bvor(
+		mk_bvnot(bool2bv(Z3_mk_bvsub_no_overflow(ctx, lhs, rhs))),
+		mk_bvnot(bool2bv(Z3_mk_bvsub_no_underflow(ctx, lhs, rhs, Z3_TRUE)))
 	);
 }
 
-SMTExpr SMTSolver::bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
-	return bvnot(bool2bv(Z3_mk_bvsub_no_underflow(ctx, lhs, rhs, Z3_FALSE)));
+SMTExpr SMTZ3::mk_bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+	return mk_bvnot(bool2bv(Z3_mk_bvsub_no_underflow(ctx, lhs, rhs, Z3_FALSE)));
 }
 
-SMTExpr SMTSolver::bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
-	return bvor(
-		bvnot(bool2bv(Z3_mk_bvmul_no_overflow(ctx, lhs, rhs, Z3_TRUE))),
-		bvnot(bool2bv(Z3_mk_bvmul_no_underflow(ctx, lhs, rhs)))
+SMTExpr SMTZ3::mk_bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+	return mk_bvor(
+		mk_bvnot(bool2bv(Z3_mk_bvmul_no_overflow(ctx, lhs, rhs, Z3_TRUE))),
+		mk_bvnot(bool2bv(Z3_mk_bvmul_no_underflow(ctx, lhs, rhs)))
 	);
 }
 
-SMTExpr SMTSolver::bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
-	return bvnot(bool2bv(Z3_mk_bvmul_no_overflow(ctx, lhs, rhs, Z3_FALSE)));
+SMTExpr SMTZ3::mk_bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+	return mk_bvnot(bool2bv(Z3_mk_bvmul_no_overflow(ctx, lhs, rhs, Z3_FALSE)));
 }
 
-SMTExpr SMTSolver::bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
-	return bvnot(bool2bv(Z3_mk_bvsdiv_no_overflow(ctx, lhs, rhs)));
+SMTExpr SMTZ3::mk_bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+	return mk_bvnot(bool2bv(Z3_mk_bvsdiv_no_overflow(ctx, lhs, rhs)));
 }
@@ -0,0 +1,199 @@
+#include <llvm/Constants.h>
+#include <llvm/Metadata.h>
+#include <llvm/Module.h>
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/InstIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/system_error.h>
+#include <vector>
+
+#include "Annotation.h"
+#include "Sidecar.h"
+#include "WordFile.h"
+
+using namespace llvm;
+
+static const char Magic[8] = { 'K', 'I', 'N', 'T', 'F', 'C', 'T', '\0' };
+static const uint32_t Version = 1;
+
+// metadata computed by intglobal; the rest is redone by annotation
+static const char *Kinds[] = { "taint", "intrange" };
+static const unsigned NumKinds = sizeof(Kinds) / sizeof(Kinds[0]);
+
+enum { OpString, OpInt };
+
+namespace {
+
+struct Fact {
+	unsigned Inst, Kind;
+	MDNode *MD;
+};
+
+struct FuncFacts {
+	Function *F;
+	std::vector<std::string> Keys;
+	std::vector<Fact> Facts;
+};
+
+} // anonymous namespace
+
+// Key each instruction of F by its global ID, its name, or its opcode
+// and source line, in that order, followed by the number of earlier
+// instructions with the same key.  Unlike positions, keys survive edits
+// elsewhere in the function.
+static void getInstKeys(Function *F, std::vector<std::string> &Keys) {
+	StringMap<unsigned> Seen;
+	Keys.clear();
+	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
+		Instruction *I = &*i;
+		std::string Key = getValueId(I);
+		if (!Key.empty())
+			Key = "id:" + Key;
+		else if (I->hasName())
+			Key = "%" + I->getName().str();
+		else {
+			Key = I->getOpcodeName();
+			DebugLoc DL = I->getDebugLoc();
+			if (!DL.isUnknown())
+				Key += "@" + Twine(DL.getLine()).str()
+				     + ":" + Twine(DL.getCol()).str();
+		}
+		unsigned &N = Seen[Key];
+		Keys.push_back(Key + "#" + Twine(N++).str());
+	}
+}
+
+static bool isSupported(MDNode *MD) {
+	for (unsigned i = 0, n = MD->getNumOperands(); i != n; ++i) {
+		Value *V = MD->getOperand(i);
+		if (!V || (!isa<MDString>(V) && !isa<ConstantInt>(V)))
+			return false;
+	}
+	return true;
+}
+
+bool writeSidecar(Module *M, uint64_t Hash, StringRef Path,
+                  std::string &Err) {
+	LLVMContext &VMCtx = M->getContext();
+	unsigned KindIDs[NumKinds];
+	for (unsigned k = 0; k != NumKinds; ++k)
+		KindIDs[k] = VMCtx.getMDKindID(Kinds[k]);
+
+	std::vector<FuncFacts> All;
+	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
+		if (f->isDeclaration())
+			continue;
+		All.push_back(FuncFacts());
+		FuncFacts &FF = All.back();
+		FF.F = &*f;
+		unsigned Inst = 0;
+		for (inst_iterator i = inst_begin(FF.F), e = inst_end(FF.F);
+		     i != e; ++i, ++Inst) {
+			for (unsigned k = 0; k != NumKinds; ++k) {
+				MDNode *MD = i->getMetadata(KindIDs[k]);
+				if (!MD || !isSupported(MD))
+					continue;
+				Fact X = { Inst, k, MD };
+				FF.Facts.push_back(X);
+			}
+		}
+		if (!FF.Facts.empty())
+			getInstKeys(FF.F, FF.Keys);
+		else
+			All.pop_back();
+	}
+
+	WordWriter W;
+	W.word64(Hash);
+	W.word(All.size());
+	for (unsigned i = 0; i != All.size(); ++i) {
+		FuncFacts &FF = All[i];
+		W.str(FF.F->getName());
+		W.word(FF.Facts.size());
+		for (unsigned j = 0; j != FF.Facts.size(); ++j) {
+			Fact &X = FF.Facts[j];
+			W.str(FF.Keys[X.Inst]);
+			W.str(Kinds[X.Kind]);
+			W.word(X.MD->getNumOperands());
+			for (unsigned k = 0, n = X.MD->getNumOperands(); k != n; ++k) {
+				Value *V = X.MD->getOperand(k);
+				if (MDString *S = dyn_cast<MDString>(V)) {
+					W.word(OpString);
+					W.str(S->getString());
+				} else {
+					W.word(OpInt);
+					W.apint(cast<ConstantInt>(V)->getValue());
+				}
+			}
+		}
+	}
+	return W.save(Path, Magic, Version, Err);
+}
+
+bool readSidecar(Module *M, uint64_t Hash, StringRef Path,
+                 std::string &Err) {
+	OwningPtr<MemoryBuffer> MB;
+	if (error_code ec = MemoryBuffer::getFile(Path, MB)) {
+		Err = ec.message();
+		return false;
+	}
+	WordReader R(MB->getBuffer(), Magic, Version);
+	if (R.failed()) {
+		Err = "not a fact file";
+		return false;
+	}
+	uint64_t FileHash = R.word64();
+	if (R.failed()) {
+		Err = "truncated fact file";
+		return false;
+	}
+	if (FileHash != Hash) {
+		Err = "module changed since analysis";
+		return false;
+	}
+
+	LLVMContext &VMCtx = M->getContext();
+	unsigned Lost = 0;
+	for (unsigned i = 0, n = R.count(); i != n; ++i) {
+		Function *F = M->getFunction(R.str());
+		StringMap<Instruction *> Insts;
+		if (F && !F->isDeclaration()) {
+			std::vector<std::string> Keys;
+			getInstKeys(F, Keys);
+			inst_iterator j = inst_begin(F);
+			for (unsigned k = 0; k != Keys.size(); ++k, ++j)
+				Insts[Keys[k]] = &*j;
+		}
+
+		for (unsigned j = 0, nf = R.count(); j != nf; ++j) {
+			StringRef Key = R.str();
+			StringRef Kind = R.str();
+			SmallVector<Value *, 2> Ops;
+			for (unsigned k = 0, no = R.count(); k != no; ++k) {
+				if (R.word() == OpString)
+					Ops.push_back(MDString::get(VMCtx, R.str()));
+				else
+					Ops.push_back(ConstantInt::get(VMCtx, R.apint()));
+			}
+			if (R.failed())
+				break;
+			StringMap<Instruction *>::iterator it = Insts.find(Key);
+			if (it != Insts.end())
+				it->second->setMetadata(Kind, MDNode::get(VMCtx, Ops));
+			else
+				++Lost;
+		}
+	}
+
+	if (R.failed()) {
+		Err = "truncated fact file";
+		return false;
+	}
+	if (Lost) {
+		Err = Twine(Lost).str() + " fact(s) for code changed since analysis";
+		return false;
+	}
+	return true;
+}
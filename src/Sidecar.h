@@ -0,0 +1,31 @@
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/DataTypes.h>
+#include <string>
+
+namespace llvm {
+	class Module;
+} // namespace llvm
+
+// Sidecar fact files keep the results of intglobal (taint and intrange
+// metadata) next to a module, instead of writing the whole module back.
+// Instructions are identified within their function by global ID, name
+// or opcode and source line, so a reader must annotate the module with
+// annotateFunction() before loading the facts.  The file records the
+// content hash (SummaryDB::hash) of the module file it was computed
+// from, and is rejected for any other version of that file.
+
+static inline std::string getSidecarPath(llvm::StringRef ModulePath) {
+	return ModulePath.str() + ".kint";
+}
+
+bool writeSidecar(llvm::Module *M, uint64_t Hash, llvm::StringRef Path,
+                  std::string &Err);
+
+// Attach the facts to M, read from a file of the given content hash.
+// A file computed from other contents is rejected; facts of
+// instructions that no longer exist are skipped and reported as an
+// error.
+bool readSidecar(llvm::Module *M, uint64_t Hash, llvm::StringRef Path,
+                 std::string &Err);
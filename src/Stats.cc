@@ -0,0 +1,137 @@
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/TimeValue.h>
+#include <llvm/Support/raw_ostream.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "IntGlobal.h"
+#include "Stats.h"
+
+using namespace llvm;
+
+static double toSeconds(const sys::TimeValue &T) {
+	return T.seconds() + T.nanoseconds() / 1e9;
+}
+
+TimeSample TimeSample::now() {
+	sys::TimeValue Elapsed, User, Sys;
+	sys::Process::GetTimeUsage(Elapsed, User, Sys);
+	TimeSample T = { toSeconds(Elapsed), toSeconds(User) + toSeconds(Sys) };
+	return T;
+}
+
+TimeSample TimeSample::nowThread() {
+	TimeSample T = now();
+	struct timespec TS;
+	if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &TS))
+		T.CPU = TS.tv_sec + TS.tv_nsec / 1e9;
+	return T;
+}
+
+// peak resident set size in kilobytes
+static uint64_t getPeakRSS() {
+	struct rusage RU;
+	if (getrusage(RUSAGE_SELF, &RU))
+		return 0;
+	return RU.ru_maxrss;
+}
+
+RunStats::PassStat &RunStats::addPass(StringRef Name) {
+	Passes.push_back(PassStat());
+	PassStat &P = Passes.back();
+	P.Name = Name;
+	return P;
+}
+
+void RunStats::endPhase(StringRef Name, GlobalContext &Ctx) {
+	TimeSample Now = TimeSample::now();
+	PhaseStat P;
+	P.Name = Name;
+	P.Time = Now - Last;
+	P.PeakRSS = getPeakRSS();
+	P.FuncPtrs = Ctx.FuncPtrs.size();
+	P.Callees = Ctx.Callees.size();
+	P.GTS = Ctx.Taints.GTS.size();
+	P.IntRanges = Ctx.IntRanges.size();
+	Phases.push_back(P);
+	Last = Now;
+}
+
+static void writeString(raw_ostream &OS, StringRef S) {
+	OS << '"';
+	for (StringRef::iterator i = S.begin(), e = S.end(); i != e; ++i) {
+		unsigned char c = *i;
+		if (c == '"' || c == '\\')
+			OS << '\\' << c;
+		else if (c < 0x20)
+			OS << format("\\u%04x", c);
+		else
+			OS << c;
+	}
+	OS << '"';
+}
+
+static void writeTime(raw_ostream &OS, const TimeSample &T) {
+	OS << "\"wall\": " << format("%.6f", T.Wall)
+	   << ", \"cpu\": " << format("%.6f", T.CPU);
+}
+
+bool RunStats::write(StringRef Path, std::string &Err) {
+	raw_fd_ostream OS(Path.str().c_str(), Err);
+	if (!Err.empty())
+		return false;
+
+	OS << "{\n  \"phases\": [";
+	for (unsigned i = 0; i != Phases.size(); ++i) {
+		PhaseStat &P = Phases[i];
+		OS << (i ? ",\n" : "\n") << "    {\"name\": ";
+		writeString(OS, P.Name);
+		OS << ", ";
+		writeTime(OS, P.Time);
+		OS << ", \"peak_rss_kb\": " << P.PeakRSS
+		   << ", \"sizes\": {\"FuncPtrs\": " << P.FuncPtrs
+		   << ", \"Callees\": " << P.Callees
+		   << ", \"GTS\": " << P.GTS
+		   << ", \"IntRanges\": " << P.IntRanges << "}}";
+	}
+	OS << "\n  ],\n  \"passes\": [";
+	for (unsigned i = 0; i != Passes.size(); ++i) {
+		PassStat &P = Passes[i];
+		OS << (i ? ",\n" : "\n") << "    {\"name\": ";
+		writeString(OS, P.Name);
+		OS << ", ";
+		writeTime(OS, P.Time);
+		OS << ",\n     \"init\": {";
+		writeTime(OS, P.Init);
+		OS << "}, \"final\": {";
+		writeTime(OS, P.Final);
+		OS << "},\n     \"iterations\": [";
+		for (unsigned j = 0; j != P.Iterations.size(); ++j) {
+			IterationStat &I = P.Iterations[j];
+			OS << (j ? ",\n" : "\n") << "      {";
+			writeTime(OS, I.Time);
+			OS << ", \"visited\": " << I.Visited
+			   << ", \"changed\": " << I.Changed << ", \"modules\": [";
+			for (unsigned k = 0; k != I.Modules.size(); ++k) {
+				ModuleStat &M = I.Modules[k];
+				OS << (k ? ",\n" : "\n") << "        {\"name\": ";
+				writeString(OS, M.Name);
+				OS << ", ";
+				writeTime(OS, M.Time);
+				OS << ", \"changed\": " << (M.Changed ? "true" : "false") << "}";
+			}
+			OS << "]}";
+		}
+		OS << "]}";
+	}
+	OS << "\n  ]\n}\n";
+
+	OS.close();
+	if (OS.has_error()) {
+		OS.clear_error();
+		Err = "write error";
+		return false;
+	}
+	return true;
+}
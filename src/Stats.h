@@ -0,0 +1,64 @@
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/DataTypes.h>
+#include <string>
+#include <vector>
+
+struct GlobalContext;
+
+// Wall-clock and CPU time of the process, in seconds
+struct TimeSample {
+	double Wall, CPU;
+
+	static TimeSample now();
+	// wall-clock time, and CPU time of the calling thread only
+	static TimeSample nowThread();
+	TimeSample operator-(const TimeSample &RHS) const {
+		TimeSample T = { Wall - RHS.Wall, CPU - RHS.CPU };
+		return T;
+	}
+};
+
+// Performance statistics of an intglobal run, written as JSON (-stats)
+class RunStats {
+public:
+	struct ModuleStat {
+		llvm::StringRef Name;
+		TimeSample Time;
+		bool Changed;
+	};
+
+	struct IterationStat {
+		TimeSample Time;
+		unsigned Visited, Changed;
+		std::vector<ModuleStat> Modules;
+	};
+
+	struct PassStat {
+		std::string Name;
+		TimeSample Time, Init, Final;
+		std::vector<IterationStat> Iterations;
+	};
+
+	// Time since the previous phase, peak RSS and sizes of the global
+	// context at the end of a phase
+	struct PhaseStat {
+		std::string Name;
+		TimeSample Time;
+		uint64_t PeakRSS;
+		unsigned FuncPtrs, Callees, GTS, IntRanges;
+	};
+
+	RunStats() : Last(TimeSample::now()) { }
+
+	PassStat &addPass(llvm::StringRef Name);
+	void endPhase(llvm::StringRef Name, GlobalContext &Ctx);
+
+	bool write(llvm::StringRef Path, std::string &Err);
+
+private:
+	TimeSample Last;
+	std::vector<PassStat> Passes;
+	std::vector<PhaseStat> Phases;
+};
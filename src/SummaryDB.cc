@@ -0,0 +1,298 @@
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file implements the summary database of intglobal.  A run seeds
+/// the global facts from the database of the previous run, and only
+/// re-analyzes modules whose content changed, plus modules that read or
+/// contributed to facts produced by changed modules.
+///
+//===----------------------------------------------------------------------===//
+
+#include <llvm/Module.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/system_error.h>
+
+#include "SummaryDB.h"
+#include "WordFile.h"
+
+using namespace llvm;
+
+static const char Magic[8] = { 'K', 'I', 'N', 'T', 'S', 'U', 'M', '\0' };
+static const uint32_t Version = 2;
+static const uint32_t NoModule = ~0U;
+
+namespace {
+
+struct OldModule {
+	StringRef Path;
+	uint64_t Hash;
+	IdSet Reads, Writes;
+	// index in the current module list, -1 if removed
+	int Index;
+	// writes of this module are no longer valid
+	bool Invalid;
+};
+
+struct OldFuncPtrs {
+	GlobalID Id;
+	std::vector<std::pair<uint32_t, StringRef> > Funcs;
+};
+
+struct OldTaint {
+	GlobalID Id;
+	bool Source;
+	DescSet Descs;
+};
+
+} // anonymous namespace
+
+static void writeIds(WordWriter &W, const IdTable &Ids, const IdSet &S) {
+	W.word(S.size());
+	for (IdSet::const_iterator i = S.begin(), e = S.end(); i != e; ++i)
+		W.str(Ids.getName(*i));
+}
+
+static bool intersects(const IdSet &A, const IdSet &B) {
+	if (A.size() > B.size())
+		return intersects(B, A);
+	for (IdSet::const_iterator i = A.begin(), e = A.end(); i != e; ++i)
+		if (B.count(*i))
+			return true;
+	return false;
+}
+
+SummaryDB::~SummaryDB() { }
+
+uint64_t SummaryDB::hash(StringRef Data) {
+	return hashBytes(Data);
+}
+
+bool SummaryDB::hashFile(StringRef Path, uint64_t &Hash) {
+	OwningPtr<MemoryBuffer> MB;
+	if (MemoryBuffer::getFile(Path, MB))
+		return false;
+	Hash = hash(MB->getBuffer());
+	return true;
+}
+
+bool SummaryDB::load(StringRef Path, ModuleList &Modules,
+                     const std::vector<uint64_t> &Hashes) {
+	OwningPtr<MemoryBuffer> MB;
+	if (MemoryBuffer::getFile(Path, MB))
+		return false;
+	WordReader R(MB->getBuffer(), Magic, Version);
+	if (R.failed())
+		return false;
+
+	IdTable &Ids = Ctx->Ids;
+	std::vector<OldModule> Old(R.count());
+	for (unsigned i = 0; i != Old.size(); ++i) {
+		OldModule &OM = Old[i];
+		OM.Path = R.str();
+		OM.Hash = R.word64();
+		for (unsigned j = 0, n = R.count(); j != n; ++j)
+			OM.Reads.insert(Ids.get(R.str()));
+		for (unsigned j = 0, n = R.count(); j != n; ++j)
+			OM.Writes.insert(Ids.get(R.str()));
+		OM.Index = -1;
+		OM.Invalid = true;
+	}
+
+	std::vector<OldFuncPtrs> FuncPtrs(R.count());
+	for (unsigned i = 0; i != FuncPtrs.size(); ++i) {
+		FuncPtrs[i].Id = Ids.get(R.str());
+		for (unsigned j = 0, n = R.count(); j != n; ++j) {
+			uint32_t Slot = R.word();
+			StringRef Name = R.str();
+			FuncPtrs[i].Funcs.push_back(std::make_pair(Slot, Name));
+		}
+	}
+
+	std::vector<OldTaint> Taints(R.count());
+	for (unsigned i = 0; i != Taints.size(); ++i) {
+		Taints[i].Id = Ids.get(R.str());
+		Taints[i].Source = R.word();
+		for (unsigned j = 0, n = R.count(); j != n; ++j)
+			Taints[i].Descs.insert(Ctx->Taints.intern(R.str()));
+	}
+
+	std::vector<std::pair<GlobalID, CRange> > Ranges;
+	for (unsigned i = 0, n = R.count(); i != n; ++i) {
+		GlobalID Id = Ids.get(R.str());
+		APInt Lower = R.apint(), Upper = R.apint();
+		if (R.failed() || Lower.getBitWidth() != Upper.getBitWidth())
+			return false;
+		// only full and empty sets have equal bounds
+		if (Lower == Upper && !Lower.isMaxValue() && !Lower.isMinValue())
+			return false;
+		Ranges.push_back(std::make_pair(Id, CRange(Lower, Upper)));
+	}
+
+	if (R.failed())
+		return false;
+
+	// match modules by path; unchanged modules are up to date
+	StringMap<unsigned> Slots;
+	for (unsigned i = 0; i != Old.size(); ++i)
+		Slots[Old[i].Path] = i;
+	unsigned n = Modules.size();
+	std::vector<bool> Stale(n, true);
+	for (unsigned i = 0; i != n; ++i) {
+		StringMap<unsigned>::iterator it = Slots.find(Modules.getName(i));
+		if (it == Slots.end())
+			continue;
+		OldModule &OM = Old[it->second];
+		if (OM.Index >= 0)
+			continue;
+		OM.Index = i;
+		if (OM.Hash == Hashes[i]) {
+			OM.Invalid = false;
+			Stale[i] = false;
+		}
+	}
+
+	// facts written by changed or removed modules are invalid
+	IdSet Invalid;
+	for (unsigned i = 0; i != Old.size(); ++i)
+		if (Old[i].Invalid)
+			Invalid.insert(Old[i].Writes.begin(), Old[i].Writes.end());
+
+	// so are function pointers to functions that no longer exist
+	std::vector<FuncSet> Resolved(FuncPtrs.size());
+	for (unsigned i = 0; i != FuncPtrs.size(); ++i) {
+		OldFuncPtrs &FP = FuncPtrs[i];
+		for (unsigned j = 0; j != FP.Funcs.size(); ++j) {
+			uint32_t Slot = FP.Funcs[j].first;
+			FuncID F = 0;
+			if (Slot != NoModule && Slot < Old.size() && Old[Slot].Index >= 0)
+				F = Ctx->FuncTab.get(Old[Slot].Index, FP.Funcs[j].second);
+			if (!F) {
+				Invalid.insert(FP.Id);
+				break;
+			}
+			Resolved[i].set(F);
+		}
+	}
+
+	// Modules reading invalid facts must be re-analyzed and their facts
+	// are invalid as well.  Modules contributing to invalid facts must be
+	// re-analyzed to contribute again.
+	bool Grew = true;
+	while (Grew) {
+		Grew = false;
+		for (unsigned i = 0; i != Old.size(); ++i) {
+			OldModule &OM = Old[i];
+			if (OM.Invalid)
+				continue;
+			if (intersects(OM.Reads, Invalid)) {
+				OM.Invalid = true;
+				Invalid.insert(OM.Writes.begin(), OM.Writes.end());
+				Stale[OM.Index] = true;
+				Grew = true;
+			} else if (intersects(OM.Writes, Invalid)) {
+				Stale[OM.Index] = true;
+			}
+		}
+	}
+
+	// seed summaries of up-to-date modules and valid facts
+	Ctx->ModuleSums.assign(n, ModuleSummary());
+	for (unsigned i = 0; i != Old.size(); ++i) {
+		OldModule &OM = Old[i];
+		if (OM.Index < 0 || Stale[OM.Index])
+			continue;
+		ModuleSummary &S = Ctx->ModuleSums[OM.Index];
+		S.Reads.swap(OM.Reads);
+		S.Writes.swap(OM.Writes);
+	}
+
+	for (unsigned i = 0; i != FuncPtrs.size(); ++i) {
+		GlobalID Id = FuncPtrs[i].Id;
+		if (!Id || Invalid.count(Id))
+			continue;
+		Ctx->FuncPtrs[Id] |= Resolved[i];
+	}
+
+	for (unsigned i = 0; i != Taints.size(); ++i) {
+		if (!Invalid.count(Taints[i].Id))
+			Ctx->Taints.add(Taints[i].Id, Taints[i].Descs, Taints[i].Source);
+	}
+
+	for (unsigned i = 0; i != Ranges.size(); ++i) {
+		GlobalID Id = Ranges[i].first;
+		if (Id && !Invalid.count(Id))
+			Ctx->IntRanges.insert(Id, Ranges[i].second);
+	}
+
+	Ctx->Stale.swap(Stale);
+	Buffer.reset(MB.take());
+	return true;
+}
+
+bool SummaryDB::save(StringRef Path, ModuleList &Modules,
+                     const std::vector<uint64_t> &Hashes, std::string &Err) {
+	WordWriter W;
+	IdTable &Ids = Ctx->Ids;
+
+	// modules
+	ModuleSummary Empty;
+	W.word(Modules.size());
+	for (unsigned i = 0; i != Modules.size(); ++i) {
+		W.str(Modules.getName(i));
+		W.word64(Hashes[i]);
+		const ModuleSummary &S =
+			i < Ctx->ModuleSums.size() ? Ctx->ModuleSums[i] : Empty;
+		writeIds(W, Ids, S.Reads);
+		writeIds(W, Ids, S.Writes);
+	}
+
+	// function pointers, functions are referred to by module and name
+	std::vector<GlobalID> Keys;
+	for (GlobalID i = 1, e = Ctx->FuncPtrs.bound(); i < e; ++i)
+		if (Ctx->FuncPtrs.count(i))
+			Keys.push_back(i);
+	W.word(Keys.size());
+	for (unsigned i = 0; i != Keys.size(); ++i) {
+		const FuncSet &FS = *Ctx->FuncPtrs.find(Keys[i]);
+		W.str(Ids.getName(Keys[i]));
+		W.word(FS.count());
+		for (FuncSet::iterator j = FS.begin(), je = FS.end(); j != je; ++j) {
+			const FuncInfo &FI = Ctx->FuncTab[*j];
+			W.word(FI.Module);
+			W.str(FI.Name);
+		}
+	}
+
+	// taints
+	Keys.clear();
+	for (GlobalID i = 1, e = Ctx->Taints.GTS.bound(); i < e; ++i)
+		if (Ctx->Taints.GTS.count(i))
+			Keys.push_back(i);
+	W.word(Keys.size());
+	for (unsigned i = 0; i != Keys.size(); ++i) {
+		const std::pair<DescSet, bool> &Entry = *Ctx->Taints.GTS.find(Keys[i]);
+		W.str(Ids.getName(Keys[i]));
+		W.word(Entry.second);
+		std::vector<unsigned> Descs;
+		Entry.first.getIndices(Descs);
+		W.word(Descs.size());
+		for (unsigned j = 0; j != Descs.size(); ++j)
+			W.str(Ctx->Taints.getDesc(Descs[j]));
+	}
+
+	// ranges
+	Keys.clear();
+	for (GlobalID i = 1, e = Ctx->IntRanges.bound(); i < e; ++i)
+		if (Ctx->IntRanges.count(i))
+			Keys.push_back(i);
+	W.word(Keys.size());
+	for (unsigned i = 0; i != Keys.size(); ++i) {
+		const CRange &CR = *Ctx->IntRanges.find(Keys[i]);
+		W.str(Ids.getName(Keys[i]));
+		W.apint(CR.getLower());
+		W.apint(CR.getUpper());
+	}
+
+	return W.save(Path, Magic, Version, Err);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/DataTypes.h>
+#include <string>
+#include <vector>
+
+#include "IntGlobal.h"
+
+namespace llvm {
+	class MemoryBuffer;
+} // namespace llvm
+
+// Persistent summaries of a previous intglobal run: global facts
+// (FuncPtrs, Taints.GTS and IntRanges), and per-module content hashes
+// and the global IDs each module reads and writes.
+//
+// The file uses the word format of WordFile.h; a magic or version
+// mismatch discards the whole database.
+class SummaryDB {
+public:
+	SummaryDB(GlobalContext *Ctx_) : Ctx(Ctx_) { }
+	~SummaryDB();
+
+	static uint64_t hash(llvm::StringRef Data);
+	static bool hashFile(llvm::StringRef Path, uint64_t &Hash);
+
+	// Seed the global context with facts that are still valid and mark
+	// modules to re-analyze in Ctx->Stale: changed modules and modules
+	// depending on facts they produced.  Return false if the file does
+	// not exist or is incompatible.
+	bool load(llvm::StringRef Path, ModuleList &Modules,
+	          const std::vector<uint64_t> &Hashes);
+
+	// Write the database atomically, replacing the old file.
+	bool save(llvm::StringRef Path, ModuleList &Modules,
+	          const std::vector<uint64_t> &Hashes, std::string &Err);
+
+private:
+	GlobalContext *Ctx;
+
+	// Seeded taint descriptions point into the mapped file
+	llvm::OwningPtr<llvm::MemoryBuffer> Buffer;
+};
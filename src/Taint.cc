@@ -23,14 +23,56 @@ static inline StringRef asString(MDNode *MD) {
 	return "";
 }
 
-static inline MDString *toMDString(LLVMContext &VMCtx, DescSet *D) {
-	std::string s;
-	for (DescSet::iterator i = D->begin(), e = D->end(); i != e; ++i) {
-		if (i != D->begin())
-			s += ", ";
-		s += (*i).str();
+// the metadata string of a taint set, built once per distinct set
+StringRef TaintPass::getDescString(const DescSet &D) {
+	std::map<DescSet, std::string>::iterator it = DescStrings.find(D);
+	if (it == DescStrings.end())
+		it = DescStrings.insert(std::make_pair(D, TM.toString(D))).first;
+	return it->second;
+}
+
+// Global taint of an ID, recorded as a dependency of the current module
+const DescSet * TaintPass::getTaint(GlobalID Id) {
+	addRead(Id);
+	return TM.get(Id);
+}
+
+bool TaintPass::addTaint(GlobalID Id, const DescSet &D, bool isSource) {
+	// global taints are final once the fixpoint is reached
+	if (isReplaying())
+		return false;
+	if (!TM.add(Id, D, isSource))
+		return false;
+	addWrite(Id);
+	Grew = true;
+
+	// values of this module reading Id
+	DenseMap<GlobalID, std::vector<Value *> >::iterator it
+		= LocalReaders.find(Id);
+	if (it == LocalReaders.end())
+		return true;
+	const DescSet &G = *TM.get(Id);
+	for (unsigned i = 0; i != it->second.size(); ++i) {
+		Value *V = it->second[i];
+		if (TM.add(V, G))
+			push(V);
 	}
-	return MDString::get(VMCtx, s);
+	return true;
+}
+
+void TaintPass::push(Value *V) {
+	if (Queued.insert(V))
+		Worklist.push_back(V);
+}
+
+// V takes the taint of Id, now and whenever it grows
+void TaintPass::addReader(GlobalID Id, Value *V) {
+	if (!Id)
+		return;
+	LocalReaders[Id].push_back(V);
+	if (const DescSet *DS = getTaint(Id))
+		if (TM.add(V, *DS))
+			push(V);
 }
 
 // Check both local taint and global sources
@@ -43,25 +85,21 @@ DescSet * TaintPass::getTaint(Value *V) {
 	// if value is not taint, check global taint.
 	// For call, taint if any possible callee could return taint
 	if (CallInst *CI = dyn_cast<CallInst>(V)) {
-		if (!CI->isInlineAsm() && Ctx->Callees.count(CI)) {
-			FuncSet &CEEs = Ctx->Callees[CI];
-			for (FuncSet::iterator i = CEEs.begin(), e = CEEs.end();
+		const FuncSet *CEEs = Ctx->getCallees(CI);
+		if (!CI->isInlineAsm() && CEEs) {
+			for (FuncSet::iterator i = CEEs->begin(), e = CEEs->end();
 				 i != e; ++i) {
-				if (DescSet *DS = TM.get(getRetId(*i)))
+				if (const DescSet *DS = getTaint(Ctx->FuncTab.getRetId(*i)))
 					TM.add(CI, *DS);
 			}
 		}
 	}
 	// For arguments and loads
-	if (DescSet *DS = TM.get(getValueId(V)))
+	if (const DescSet *DS = getTaint(Ctx->Ids.getValueId(V)))
 		TM.add(V, *DS);
 	return TM.get(V);
 }
 
-bool TaintPass::isTaintSource(const std::string &sID) {
-	return TM.isSource(sID);
-}
-
 // find and mark taint source
 bool TaintPass::checkTaintSource(Instruction *I)
 {
@@ -69,83 +107,86 @@ bool TaintPass::checkTaintSource(Instruction *I)
 	bool changed = false;
 
 	if (MDNode *MD = I->getMetadata(MD_TaintSrc)) {
-		TM.add(I, asString(MD));
+		if (TM.add(I, TM.intern(asString(MD))))
+			push(I);
 		DescSet &D = *TM.get(I);
-		changed |= TM.add(getValueId(I), D, true);
+		changed |= addTaint(Ctx->Ids.getValueId(I), D, true);
 		// mark all struct members as taint
 		if (PointerType *PTy = dyn_cast<PointerType>(I->getType())) {
 			if (StructType *STy = dyn_cast<StructType>(PTy->getElementType())) {
 				for (unsigned i = 0; i < STy->getNumElements(); ++i)
-					changed |= TM.add(getStructId(STy, M, i), D, true);
+					changed |= addTaint(
+						Ctx->Ids.get(getStructId(STy, M, i)), D, true);
 			}
 		}
 	}
 	return changed;
 }
 
-// Propagate taint within a function
-bool TaintPass::runOnFunction(Function *F)
+// mark corresponding args tainted on all possible callees
+void TaintPass::propagate(CallInst *CI, Value *Arg)
 {
-	bool changed = false;
+	const FuncSet *CEEs = Ctx->getCallees(CI);
+	if (CI->isInlineAsm() || !CEEs)
+		return;
+
+	const DescSet &D = *TM.get(Arg);
+	for (FuncSet::iterator j = CEEs->begin(), je = CEEs->end();
+		 j != je; ++j) {
+		// skip vaarg and builtin functions
+		const FuncInfo &FI = Ctx->FuncTab[*j];
+		if (FI.isVarArg || FI.Name.find('.') != StringRef::npos)
+			continue;
 
-	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
-		Instruction *I = &*i;
-		
-		// find and mark taint sources
-		changed |= checkTaintSource(I);
+		for (unsigned a = 0; a < CI->getNumArgOperands(); ++a) {
+			if (CI->getArgOperand(a) == Arg)
+				addTaint(Ctx->FuncTab.getArgId(*j, a), D);
+		}
+	}
+}
 
+// Propagate the taint of V to its users
+void TaintPass::propagate(Value *V)
+{
+	const DescSet &D = *TM.get(V);
+	for (Value::use_iterator i = V->use_begin(), e = V->use_end();
+	     i != e; ++i) {
 		// for call instruction, propagate taint to arguments instead
 		// of from arguments
-		if (CallInst *CI = dyn_cast<CallInst>(I)) {
-			if (CI->isInlineAsm() || !Ctx->Callees.count(CI))
-				continue;
-
-			FuncSet &CEEs = Ctx->Callees[CI];
-			for (FuncSet::iterator j = CEEs.begin(), je = CEEs.end();
-				 j != je; ++j) {
-				// skip vaarg and builtin functions
-				if ((*j)->isVarArg() 
-					|| (*j)->getName().find('.') != StringRef::npos)
-					continue;
-				
-				// mark corresponding args tainted on all possible callees
-				for (unsigned a = 0; a < CI->getNumArgOperands(); ++a) {
-					if (DescSet *DS = getTaint(CI->getArgOperand(a)))
-						changed |= TM.add(getArgId(*j, a), *DS);
-				}
-			}
+		if (CallInst *CI = dyn_cast<CallInst>(*i)) {
+			propagate(CI, V);
 			continue;
 		}
 
-		// check if any operand is taint
-		DescSet D;
-		for (unsigned j = 0; j < I->getNumOperands(); ++j)
-			if (DescSet *DS = getTaint(I->getOperand(j)))
-				D.insert(DS->begin(), DS->end());
-		if (D.empty())
+		Instruction *I = dyn_cast<Instruction>(*i);
+		if (!I || !TM.add(I, D))
 			continue;
 
 		// propagate value and global taint
-		TM.add(I, D);
 		if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
-			if (MDNode *ID = SI->getMetadata(MD_ID))
-				changed |= TM.add(asString(ID), D);
+			addTaint(Ctx->Ids.getValueId(SI), *TM.get(I));
 		} else if (isa<ReturnInst>(I)) {
-			changed |= TM.add(getRetId(F), D);
-		}
+			addTaint(Ctx->Ids.getRetId(I->getParent()->getParent()),
+			         *TM.get(I));
+		} else
+			push(I);
 	}
-	return changed;
 }
 
 // write back
 bool TaintPass::doFinalization(Module *M) {
 	LLVMContext &VMCtx = M->getContext();
+	// each module has its own context, so nodes are shared per module
+	std::map<DescSet, MDNode *> Nodes;
 	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
 		Function *F = &*f;
 		for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
 			Instruction *I = &*i;
 			if (DescSet *DS = getTaint(I)) {
-				MDNode *MD = MDNode::get(VMCtx, toMDString(VMCtx, DS));
+				MDNode *&MD = Nodes[*DS];
+				if (!MD)
+					MD = MDNode::get(VMCtx,
+						MDString::get(VMCtx, getDescString(*DS)));
 				I->setMetadata(MD_Taint, MD);
 			} else
 				I->setMetadata(MD_Taint, NULL);
@@ -154,27 +195,66 @@ bool TaintPass::doFinalization(Module *M) {
 	return true;
 }
 
+// Seed the worklist with taint sources and values reading global taint,
+// then propagate along def-use chains until the module is stable
 bool TaintPass::doModulePass(Module *M) {
-	bool changed = true, ret = false;
+	Grew = false;
+	LocalReaders.clear();
+
+	std::vector<FuncSCC> SCCs;
+	getFuncSCCs(M, SCCs);
+	for (unsigned s = 0; s != SCCs.size(); ++s) {
+		for (unsigned f = 0; f != SCCs[s].Funcs.size(); ++f) {
+			Function *F = SCCs[s].Funcs[f];
+			for (Function::arg_iterator a = F->arg_begin(), ae = F->arg_end();
+			     a != ae; ++a)
+				addReader(Ctx->Ids.getValueId(&*a), &*a);
+
+			for (inst_iterator i = inst_begin(F), e = inst_end(F);
+			     i != e; ++i) {
+				Instruction *I = &*i;
+				checkTaintSource(I);
+
+				// taint if any possible callee could return taint
+				if (CallInst *CI = dyn_cast<CallInst>(I)) {
+					const FuncSet *CEEs = Ctx->getCallees(CI);
+					if (!CI->isInlineAsm() && CEEs) {
+						for (FuncSet::iterator j = CEEs->begin(),
+						     je = CEEs->end(); j != je; ++j)
+							addReader(Ctx->FuncTab.getRetId(*j), CI);
+					}
+					addReader(Ctx->Ids.getValueId(CI), CI);
+				} else if (isa<LoadInst>(I)) {
+					addReader(Ctx->Ids.getValueId(I), I);
+				}
+			}
+		}
+	}
 
-	while (changed) {
-		changed = false;
-		for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i)
-			changed |= runOnFunction(&*i);
-		ret |= changed;
+	while (!Worklist.empty()) {
+		Value *V = Worklist.back();
+		Worklist.pop_back();
+		Queued.erase(V);
+		propagate(V);
 	}
-	return ret;
+	return Grew;
 }
 
 // debug
 void TaintPass::dumpTaints() {
 	raw_ostream &OS = dbgs();
-	for (TaintMap::GlobalMap::iterator i = TM.GTS.begin(), 
-		 e = TM.GTS.end(); i != e; ++i) {
-		OS << (i->second.second ? "S " : "  ") << i->first << "\t";
-		for (DescSet::iterator j = i->second.first.begin(),
-			je = i->second.first.end(); j != je; ++j)
-				OS << *j << " ";
+	std::vector<GlobalID> Ids;
+	for (GlobalID i = 1, e = TM.GTS.bound(); i != e; ++i)
+		if (TM.GTS.count(i))
+			Ids.push_back(i);
+	Ctx->Ids.sort(Ids);
+	for (unsigned i = 0; i != Ids.size(); ++i) {
+		const std::pair<DescSet, bool> &entry = *TM.GTS.find(Ids[i]);
+		OS << (entry.second ? "S " : "  ") << Ctx->Ids.getName(Ids[i]) << "\t";
+		std::vector<unsigned> Descs;
+		entry.first.getIndices(Descs);
+		for (unsigned j = 0; j != Descs.size(); ++j)
+				OS << TM.getDesc(Descs[j]) << " ";
 		OS << "\n";
 	}
 }
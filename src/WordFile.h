@@ -0,0 +1,190 @@
+#pragma once
+
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/DataTypes.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/system_error.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Binary files of intglobal (the summary database and the sidecar fact
+// files) are sequences of 32-bit words in host byte order, so that they
+// can be read directly from a memory mapping.  A file starts with an
+// 8-byte magic string, a format version and a table of strings, which
+// the rest of the file refers to by index.
+
+// 64-bit FNV-1a, identifying the contents of an input file
+static inline uint64_t hashBytes(llvm::StringRef Data) {
+	uint64_t H = 14695981039346656037ULL;
+	for (llvm::StringRef::iterator i = Data.begin(), e = Data.end();
+	     i != e; ++i) {
+		H ^= (unsigned char)*i;
+		H *= 1099511628211ULL;
+	}
+	return H;
+}
+
+// Read words from a mapped file; reading past the end or a header
+// mismatch marks the reader as failed.
+class WordReader {
+public:
+	WordReader(llvm::StringRef Data, const char *Magic, uint32_t Version)
+		: Cur(Data.begin()), End(Data.end()), Failed(false) {
+		if (Data.size() < 8 || memcmp(Cur, Magic, 8)) {
+			fail();
+			return;
+		}
+		Cur += 8;
+		if (word() != Version) {
+			fail();
+			return;
+		}
+		Strings.resize(count());
+		for (unsigned i = 0; i != Strings.size(); ++i)
+			Strings[i] = bytes(word());
+	}
+
+	bool failed() const { return Failed; }
+
+	uint32_t word() {
+		uint32_t W = 0;
+		if (End - Cur < 4)
+			return fail();
+		memcpy(&W, Cur, 4);
+		Cur += 4;
+		return W;
+	}
+
+	uint64_t word64() {
+		uint64_t Lo = word();
+		return Lo | ((uint64_t)word() << 32);
+	}
+
+	// number of following items, each of which takes at least a word
+	uint32_t count() {
+		uint32_t n = word();
+		if (n > (End - Cur) / 4)
+			return fail();
+		return n;
+	}
+
+	// reference to the string table
+	llvm::StringRef str() {
+		uint32_t i = word();
+		if (i >= Strings.size()) {
+			fail();
+			return llvm::StringRef();
+		}
+		return Strings[i];
+	}
+
+	llvm::APInt apint() {
+		uint32_t Width = word();
+		if (Width == 0 || Width > (End - Cur) * 8) {
+			fail();
+			return llvm::APInt(1, 0);
+		}
+		llvm::SmallVector<uint64_t, 2> Words;
+		for (unsigned i = 0, n = (Width + 63) / 64; i != n; ++i)
+			Words.push_back(word64());
+		return llvm::APInt(Width, Words);
+	}
+
+private:
+	const char *Cur, *End;
+	bool Failed;
+	std::vector<llvm::StringRef> Strings;
+
+	llvm::StringRef bytes(uint32_t Len) {
+		uint64_t Padded = ((uint64_t)Len + 3) & ~(uint64_t)3;
+		if ((uint64_t)(End - Cur) < Padded) {
+			fail();
+			return llvm::StringRef();
+		}
+		llvm::StringRef S(Cur, Len);
+		Cur += Padded;
+		return S;
+	}
+
+	uint32_t fail() {
+		Failed = true;
+		Cur = End;
+		return 0;
+	}
+};
+
+// Build a file in memory, collecting strings into the table.
+class WordWriter {
+public:
+	void word(uint32_t W) {
+		Body.append((const char *)&W, 4);
+	}
+
+	void word64(uint64_t W) {
+		word((uint32_t)W);
+		word((uint32_t)(W >> 32));
+	}
+
+	void str(llvm::StringRef S) {
+		llvm::StringMapEntry<uint32_t> &E =
+			Index.GetOrCreateValue(S, Strings.size());
+		if (E.getValue() == Strings.size())
+			Strings.push_back(E.getKey());
+		word(E.getValue());
+	}
+
+	void apint(const llvm::APInt &V) {
+		word(V.getBitWidth());
+		for (unsigned i = 0; i != V.getNumWords(); ++i)
+			word64(V.getRawData()[i]);
+	}
+
+	// Write to a temporary file and rename it, so that concurrent
+	// readers (or a mapping of the old file) never see a partial file.
+	bool save(llvm::StringRef Path, const char *Magic, uint32_t Version,
+	          std::string &Err) {
+		std::string Tmp = Path.str() + ".tmp";
+		{
+			llvm::raw_fd_ostream OS(Tmp.c_str(), Err,
+			                        llvm::raw_fd_ostream::F_Binary);
+			if (!Err.empty())
+				return false;
+			write(OS, Magic, Version);
+			OS.close();
+			if (OS.has_error()) {
+				OS.clear_error();
+				Err = "write error";
+				return false;
+			}
+		}
+		if (llvm::error_code ec = llvm::sys::fs::rename(Tmp, Path)) {
+			Err = ec.message();
+			return false;
+		}
+		return true;
+	}
+
+private:
+	std::string Body;
+	llvm::StringMap<uint32_t> Index;
+	std::vector<llvm::StringRef> Strings;
+
+	void write(llvm::raw_ostream &OS, const char *Magic, uint32_t Version) {
+		static const char Pad[4] = { 0 };
+		uint32_t Header[] = { Version, (uint32_t)Strings.size() };
+		OS.write(Magic, 8);
+		OS.write((const char *)Header, sizeof(Header));
+		for (unsigned i = 0; i != Strings.size(); ++i) {
+			uint32_t Len = Strings[i].size();
+			OS.write((const char *)&Len, 4);
+			OS << Strings[i];
+			OS.write(Pad, (4 - Len % 4) % 4);
+		}
+		OS << Body;
+	}
+};